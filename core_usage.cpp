@@ -35,13 +35,18 @@
 *************************************************************************/
 
 
-// Compile: g++ -O2 -o core_usage core_usage.cpp -lX11 -lncurses
+// Compile: g++ -O2 -o core_usage core_usage.cpp -lX11 -lncurses -lpthread
 // Run:     ./core_usage [t_interval] [txt]
 //          t_interval - the time interval (in seconds) for info update
 //          The GUI will show up if X11 is available. If not, the 
 //          console version will run. If you want to run the console 
 //          version even you have X11, you can add parammeter "txt". 
 //          ./core_usage 1.0 txt
+//
+//          Front ends can be left out at build time. -DNO_X11 drops the 
+//          GUI and libX11, -DNO_NCURSES drops the terminal version and 
+//          libncurses. With both, only the headless version (log, record, 
+//          flight recorder and summary) is built. See the Makefile. 
 
 // Written by Lei Huang at Texas Advanced Computing Center.
 //
@@ -55,16 +60,30 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#ifndef NO_X11
 #include <X11/Xlib.h>
 #include <X11/Xutil.h>
+#endif
 #include <sys/time.h>
 #include <time.h>
 #include <ctype.h>
+#ifndef NO_NCURSES
 #include <curses.h>
+#endif
 #include <signal.h>
 #include <dirent.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+
+#if defined(__linux__) && defined(__NR_io_uring_setup) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#define HAVE_IO_URING
+#endif
 
 
 #define MAX_CORE	(1024)
@@ -104,12 +123,16 @@ struct timeval tv;
 struct timeval stv;
 struct timeval tv_period;
 
+#ifndef NO_X11
 Display *dis;
 Window win;
 int screen;
 GC gc;
+#endif
 
 int my_pid=-1, my_uid=-1;
+#define MAX_SELF_TID	(64)
+int Sampler_Tid=-1, Self_Tid[MAX_SELF_TID], nSelf_Tid=0;	// my own threads. Skipped in cgroup mode, where my process is in the task list. 
 int nCore, nThread_per_Core, nCPU;
 unsigned long long cur_user[MAX_CORE], cur_nice[MAX_CORE], cur_system[MAX_CORE], cur_idle[MAX_CORE], 
 cur_iowait[MAX_CORE], cur_irq[MAX_CORE], cur_softirq[MAX_CORE], cur_steal[MAX_CORE];
@@ -126,6 +149,133 @@ int ThreadID[MAX_CORE];	// store the thread index on the core it sits in. Termin
 int nApp_Core[MAX_CORE];
 char szAppList[MAX_CORE][MAX_APP][MAX_APP_NAME_LEN];
 
+#define IDLE_THRESHOLD	(0.02)	// a core with usage below this is considered idle
+#define MAX_TRACKED_THREAD	(65536)	// size of the hash table tracking which core each thread ran on. Must be a power of 2. 
+
+typedef struct	{
+	int tid;	// 0 means an empty slot
+	int tgid;	// the process. 0 if not known yet, -1 if the lookup failed. 
+	int core;
+	int bBusy;	// running and attributed to the core. Idle threads are kept for CPU accounting only. 
+	unsigned long long cpu_ticks;	// utime + stime
+	unsigned long long run_ns, wait_ns, nSlice;	// from /proc/<tid>/schedstat. wait_ns is the time spent on a run queue. 
+}THREAD_CORE_REC;
+
+THREAD_CORE_REC Thread_Core_Tab[2][MAX_TRACKED_THREAD];	// [idx_Tab_Cur] is filled in current scan, the other one holds the previous scan
+int idx_Tab_Cur=0, nMigration=0, bTab_Old_Valid=0, bTab_Full[2]={0, 0};
+struct timeval tv_Last_Scan;
+
+#define MAX_APP_TRACKED	(4096)	// distinct executables (and processes) aggregated in one scan. Must be a power of 2. 
+#define APP_TOP_N	(8)	// the length of the ranking
+#define APP_TOP_SHOWN	(5)	// the lines of the ranked panel and the GUI legend
+
+typedef struct	{
+	char szName[MAX_APP_NAME_LEN];
+	int pid;	// the process id. 0 for an executable. 
+	int nThread, nProc;	// active threads and processes
+	unsigned long long Ticks;	// CPU time used in current scan
+	float CPU;	// the number of cores used on average
+	unsigned char bCore[MAX_CORE/8];	// the cores its busy threads run on
+}APP_REC;
+
+APP_REC App_Tab[MAX_APP_TRACKED], Proc_Tab[MAX_APP_TRACKED];	// hash tables with linear probing. Reset through the used lists. 
+APP_REC App_Other, Proc_Other;	// everything beyond 3/4 of the hash tables goes here
+int App_Used[MAX_APP_TRACKED], nApp_Used=0, Proc_Used[MAX_APP_TRACKED], nProc_Used=0;
+APP_REC Top_App[APP_TOP_N], Top_Proc[APP_TOP_N];	// ranked by CPU in descending order
+int nTop_App=0, nTop_Proc=0, Core_Top_App[MAX_CORE];	// Core_Top_App[] is the rank of the top app on each core, -1 if none
+float Total_App_CPU=0.0;
+#define APP_LEGEND_HEIGHT	(14*APP_TOP_SHOWN)	// extra room at the bottom of the GUI
+const unsigned long App_Color[APP_TOP_SHOWN]={0x008080, 0xC06000, 0x8000C0, 0x608000, 0xC00060};	// legend colors of the top apps
+long nClock_Tick=100;
+
+int NodeID[MAX_CORE];	// NUMA node of each logic core. Falls back to the socket id if NUMA info is not available. 
+int bOverSub_Core[MAX_CORE];	// 0 - fine; 1 - more than one busy thread of mine; 2 - oversubscribed while other cores on the same node are idle
+int nCore_OverSub=0, nCore_Idle=0;
+float Migration_Rate=0.0;	// thread migrations per second between the last two scans
+
+float Core_Wait[MAX_CORE];	// seconds per second my threads on this core spent waiting on the run queue
+float Core_Wait_Latency[MAX_CORE];	// average run-queue wait per timeslice (in microseconds) on this core
+unsigned long long Core_Wait_ns[MAX_CORE], Core_nSlice[MAX_CORE];	// accumulated in current scan
+float Total_Wait=0.0, Max_Wait=0.0, Avg_Wait_Latency=0.0;
+int Core_Max_Wait=0;
+
+int bCore_Shown[MAX_CORE];	// 1 if the core is displayed. Cores outside the cpuset of the monitored cgroup are hidden. 
+int nCore_Shown=0, Core_Shown_List[MAX_CORE];
+int Row_Core[MAX_CORE];	// the row of each logic core in the terminal version
+int Row_Label[MAX_CORE], bRow_Socket_Start[MAX_CORE];	// the core index printed on each row and whether the row starts a socket
+
+int bCgroup=0;	// monitor the tasks in a cgroup instead of walking /proc
+char szCgroup_Dir[512], szCgroup_Task_File[64], szCgroup_CPU_Stat[512];
+unsigned long long Cgroup_nPeriod=0, Cgroup_nThrottled=0, Cgroup_Throttled_ns=0;	// counters from cpu.stat in last scan
+int Throttled_Periods=0, Total_Periods=0;	// in last interval
+float Throttle_Time=0.0;	// seconds per second throttled in last interval
+
+#define MIN_SAMPLE_RING	(256)	// slots in the ring between the sampler thread and the renderer
+#define MAX_SAMPLE_RING	(65536)
+#define PROC_STAT_BUF_SIZE	(1024*1024)
+
+int bSampler=0;	// sample per-core counters in a separate thread at a higher rate than the display
+int bSampler_Running=0;	// set by the sampler thread once it reads /proc/stat. Only then the statistics come from the ring. 
+float tSample=0.01;	// sampling period in seconds
+float *Sample_Ring=NULL;	// nSample_Ring slots of nCore usage values followed by the seconds the slot covers
+unsigned int nSample_Ring=MIN_SAMPLE_RING;	// a power of 2. Holds two frames of samples. 
+unsigned int Ring_Head=0, Ring_Tail=0;	// Ring_Head is only written by the sampler and Ring_Tail only by the renderer
+unsigned long long Sampler_ns=0, nSample_Taken=0, nSample_Dropped=0;	// written by the sampler. CPU time used by the sampler. 
+float Core_Usage_Min[MAX_CORE], Core_Usage_Max[MAX_CORE];	// over the samples since last frame. Core_Usage[] is the mean. 
+float Sample_Rate=0.0, Sampler_Load=0.0, Sampler_us_per_Sample=0.0;	// measured in last frame
+pthread_t Sampler_Thread_ID;
+
+#define USAGE_BINS	(200)	// 0.5% per bin. Usage is bounded in [0, 1], so a fixed histogram is a constant-memory quantile sketch. 
+
+unsigned int Usage_Hist[MAX_CORE][USAGE_BINS+1];	// the last bin holds exactly 100%
+double Sum_Usage[MAX_CORE], Idle_Time[MAX_CORE], Idle_Run[MAX_CORE], Idle_Run_Max[MAX_CORE];	// in seconds
+double Stat_Time=0.0, tStat_Last=-1.0;
+unsigned long long nStat_Sample=0;
+volatile sig_atomic_t bSummary_Requested=0;	// set by SIGUSR1
+volatile sig_atomic_t bQuit_Requested=0;	// set by SIGINT/SIGTERM. The main loop prints the summary and quits. 
+
+#define N_IRQ_CLASS	(5)
+#define IRQ_NET	(0)	// NIC queues and NET_RX/NET_TX softirqs
+#define IRQ_BLK	(1)	// storage (NVMe, SATA, virtio-blk) and BLOCK softirqs
+#define IRQ_TMR	(2)	// local timer and TIMER/HRTIMER softirqs
+#define IRQ_IPI	(3)	// rescheduling, function call and TLB shootdown
+#define IRQ_OTH	(4)
+#define IRQ_HOT_THRESHOLD	(1000.0)	// NET+BLK interrupts per second on a core running my app to be reported as hotspot
+
+const char *szIRQ_Class[N_IRQ_CLASS]={"NET", "BLK", "TMR", "IPI", "OTH"};
+
+int bIRQ=0;	// sample /proc/interrupts and /proc/softirqs
+int fd_Interrupts=-1, fd_Softirqs=-1;	// kept open between samples
+char *szIRQ_Buf=NULL;	// grows to hold the whole file. /proc/interrupts is very wide with many cores. 
+int IRQ_Buf_Size=0;
+unsigned long long IRQ_Count[N_IRQ_CLASS][MAX_CORE], IRQ_Count_Old[N_IRQ_CLASS][MAX_CORE];
+float IRQ_Rate[N_IRQ_CLASS][MAX_CORE], IRQ_Rate_Total[MAX_CORE];	// per second
+int IRQ_Top_Class[MAX_CORE], bIRQ_Hot[MAX_CORE], nIRQ_Hot=0;
+
+#define URING_BATCH	(256)	// threads per io_uring submission
+#define URING_SLOT_SIZE	(512)	// buffer size per file
+
+int bUring=0;	// read /proc/<tid>/stat and schedstat in batches through io_uring
+int Uring_Batch_Pid[URING_BATCH], Uring_Batch_Tid[URING_BATCH], nUring_Batch=0;	// pid is 0 if unknown
+unsigned long long nFile_Syscall=0;	// syscalls used to read the per-thread files. For benchmarking. 
+int nThread_Scanned=0;
+
+#ifdef HAVE_IO_URING
+typedef struct	{
+	int fd;
+	unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+	unsigned *cq_head, *cq_tail, *cq_mask;
+	struct io_uring_sqe *sqes;
+	struct io_uring_cqe *cqes;
+	char *Buf;	// URING_BATCH slots of URING_SLOT_SIZE bytes. Registered as a fixed buffer. 
+	char szPath[URING_BATCH][48];
+	char *p_SQ, *p_CQ;	// the mappings, kept to unmap them
+	size_t sq_size, cq_size, sqes_size;
+}URING_INFO;
+
+URING_INFO Uring;
+#endif
+
 int bar_width, bar_height=200, extra=55, x0, y0, win_width, win_height;
 char szHostName[256];
 
@@ -133,7 +283,70 @@ int bLog_CPU_Usage=0, nCountLog=0;
 double tNow=0.0;
 void Output_Core_Usage(void);
 
+#define RECORD_MAGIC	"CORUSG2"
+
+typedef struct	{	// the header of a record file. Followed by SocketID[], CoreID[], ThreadID[], NodeID[] and bCore_Shown[] of nCore entries. 
+	char szMagic[8];
+	int nCore, nSocket, nCore_Socket, nThread_per_Core;
+	float tInterval;
+	char szHostName[64];
+}RECORD_HEADER;
+
+typedef struct	{	// the header of a frame. Followed by the raw counters of /proc/stat and nCore_App RECORD_APP_CORE. 
+	double t;	// seconds since the recording started
+	int nCore_App;	// the number of cores with app attribution
+	int Core_Max_Wait;
+	float Migration_Rate, Total_Wait, Max_Wait, Avg_Wait_Latency;
+}RECORD_FRAME;
+
+typedef struct	{	// followed by min(nApp, MAX_APP) app names of MAX_APP_NAME_LEN bytes
+	int core, nApp;
+	float Wait, Wait_Latency;
+}RECORD_APP_CORE;
+
+FILE *fRecord=NULL, *fReplay=NULL;
+float Replay_Speed=1.0;	// 0 means as fast as possible
+int nFrame_Replayed=0;
+struct timeval tv_Record_Start, tv_Replay_Start;
+
+#define MAX_FRAME_SIZE	(sizeof(RECORD_FRAME) + 8*sizeof(unsigned long long)*MAX_CORE + MAX_CORE*(sizeof(RECORD_APP_CORE) + MAX_APP*MAX_APP_NAME_LEN))
+#define MAX_HEADER_SIZE	(sizeof(RECORD_HEADER) + 5*sizeof(int)*MAX_CORE)
+
+char Frame_Buf[MAX_FRAME_SIZE];	// one serialized frame
+
+#define MAX_FLIGHT_FRAME	(1000)	// pre + post window. Dumped with one writev(), so it must stay below IOV_MAX. 
+
+int bFlight=0, Flight_Pre=30, Flight_Post=10, nFlight_Slot=0, Flight_Slot_Size=0;
+char *Flight_Ring=NULL;	// nFlight_Slot serialized frames of Flight_Slot_Size bytes
+int *Flight_Len=NULL, iFlight_Head=0, nFlight_Frame=0, nPost_Left=-1, nFlight_Dump=0;
+int bRule_Idle=0, bRule_Socket=0, bRule_Share=0, bRule_Last[3]={0, 0, 0}, bApp_Last[MAX_CORE];	// bApp_Last[] - my app ran on the core and it has not gone idle since
+float Idle_Threshold=0.1, Socket_Threshold=0.95;
+int Share_Threshold=2;
+char szFlight_Reason[128], szFlight_Last[512]="";
+struct timeval tv_Flight_Start;
+
+void Open_Record_File(char szName[]);
+void Write_Record_Frame(void);
+int Serialize_Header(char *pBuf);
+int Serialize_Frame(char *pBuf, double t);
+int Parse_Trigger_Rules(char szRules[]);
+void Init_Flight_Recorder(void);
+void Flight_Recorder_Tick(void);
+int Evaluate_Triggers(char szReason[]);
+void Dump_Flight_Window(void);
+void Open_Replay_File(char szName[]);
+int Read_Replay_Frame(void);
+void Finish_Replay(void);
+
+#ifndef NO_X11
 void timerFired();
+void DrawLines(void);
+void Run_GUI_version(void);
+#endif
+#ifndef NO_NCURSES
+void Run_Terminal_version(void);
+#endif
+void Run_Headless_version(void);
 void Init_Core_Stat();
 void Read_Proc_Stat(void);
 void Save_Core_Stat(void);
@@ -141,23 +354,66 @@ void Cal_Core_Usage(void);
 void Setup_bar_width(void);
 
 void Format_Two_Digital(int number, char szBuf[]);
-static void Clean_up(int sig, siginfo_t *siginfo, void *ptr);	// Used by terminal version
+static void Clean_up(int sig, siginfo_t *siginfo, void *ptr);	// SIGINT/SIGTERM handler. Only sets bQuit_Requested. 
+void Quit_With_Summary(void);
 void Extract_Thread_Mapping_Info(void);	// Used by terminal version
 int Get_Logic_Core_ID(int Phys_Cores_on_Socket[], int Phys_Core_ID, int& Thread);
 
-void Extract_Exec_Name(int pid, char szExeName[], int* core, float* utime);
-int Is_Thread_Running(char szName[]);
+int Extract_Exec_Name(int pid, char szExeName[], int* core, float* utime, unsigned long long *cpu_ticks);
 void Enumerate_All_PID(void);
+unsigned long long Track_Thread(int tid, int *pid, int core, int bBusy, unsigned long long cpu_ticks, unsigned long long run_ns, unsigned long long wait_ns, unsigned long long nSlice);
+int Read_Sched_Stat(int tid, unsigned long long *run_ns, unsigned long long *wait_ns, unsigned long long *nSlice);
+void Read_NUMA_Node_Info(void);
+void Analyze_Placement(void);
+int Read_CPU_List(char szFile[], int bInList[]);
+void Setup_Core_Layout(void);
+void Check_Thread(int pid, int tid);
+void Read_Self_Tids(void);
+int Is_Self_Tid(int tid);
+void Account_Thread(int pid, int tid, char szExeName[], int core, int bBusy, unsigned long long cpu_ticks, unsigned long long run_ns, unsigned long long wait_ns, unsigned long long nSlice);
+int Parse_Thread_Stat(char szBuff[], char szExeName[], int* core, float* utime, unsigned long long *cpu_ticks);
+APP_REC *Find_App_Rec(APP_REC Tab[], int Used[], int *nUsed, APP_REC *pOther, char szName[], int pid, int *bNew);
+void Add_App_CPU(int pid, int tid, char szExeName[], int core, int bBusy, unsigned long long Ticks);
+int Read_Tgid(int tid);
+void Read_Proc_Name(int pid, char szName[]);
+void Rank_Apps(double dt);
+void Push_Top_N(APP_REC *Heap[], int *nHeap, APP_REC *pApp);
+int Sort_Top_N(APP_REC *Heap[], int nHeap, APP_REC Top[]);
+void Format_Core_List(unsigned char bCore[], char szBuf[], int nMaxLen);
+int Init_Uring(void);
+void Close_Uring(void);
+int Uring_Read_Batch(int n, int tid[], const char *szFormat, int Len[]);
+void Flush_Uring_Batch(void);
+void Bench_Scan(int nScan);
+void Setup_Cgroup(char szPath[]);
+int Is_Keyword(char szArg[]);
+void Enumerate_Cgroup_Tasks(char szDir[]);
+int Format_Path(char szDest[], size_t nSize, const char szFmt[], const char szA[], const char szB[]);
+int Read_Cgroup_CPU_Stat(unsigned long long *nPeriod, unsigned long long *nThrottled, unsigned long long *Throttled_ns);
+void Start_Sampler(void);
+void *Sampler_Main(void *arg);
+int Parse_Proc_Stat_Buf(char *szBuf, unsigned long long Busy[], unsigned long long Total[]);
+void Drain_Sample_Ring(void);
+void Update_Core_Stats(float Usage[], double dt);
+float Usage_Percentile(int core, float p);
+void Print_Summary(FILE *fOut);
+void Write_Summary_File(void);
+static void Request_Summary(int sig);
+void Init_Interrupt_Stat(void);
+void Sample_Interrupts(void);
+int Read_Whole_File(int fd);
+void Parse_Interrupt_Table(int bSoftirq);
+int Classify_Interrupt(char szLabel[], char szDesc[], int bSoftirq);
 
 void Setup_bar_width(void)
 {
-	if(nCore <= 24)	{
+	if(nCore_Shown <= 24)	{
 		bar_width = 36;
 	}
-	else if(nCore <= 64)	{
+	else if(nCore_Shown <= 64)	{
 		bar_width = 16;
 	}
-	else if(nCore <= 128)	{
+	else if(nCore_Shown <= 128)	{
 		bar_width = 12;
 	}
 	else	{
@@ -169,8 +425,16 @@ void Cal_Core_Usage(void)
 {
 	int i;
 	unsigned long long cur_Idle, cur_NonIdle, old_Idle, old_NonIdle;
+	struct timeval tv_Now;
+	double t;
 	
-	Read_Proc_Stat();
+	if(fReplay)	{
+		if(Read_Replay_Frame() == 0)	Finish_Replay();
+	}
+	else	{
+		Read_Proc_Stat();
+		if(fRecord)	Write_Record_Frame();
+	}
 	
 	for(i=0; i<nCore; i++)	{
 		cur_Idle = cur_idle[i] + cur_iowait[i];
@@ -185,9 +449,28 @@ void Cal_Core_Usage(void)
 	
 	Save_Core_Stat();
 
+	if(fReplay)	{
+		t = tNow;	// the time stamp of the frame
+	}
+	else	{
+		gettimeofday(&tv_Now, 0);
+		t = tv_Now.tv_sec + 0.000001*tv_Now.tv_usec;
+	}
+	if(__atomic_load_n(&bSampler_Running, __ATOMIC_ACQUIRE))	Drain_Sample_Ring();	// the statistics are updated with every sample there
+	else if(tStat_Last >= 0.0)	Update_Core_Stats(Core_Usage, t - tStat_Last);
+	tStat_Last = t;
+	if(bIRQ && (fReplay == NULL))	Sample_Interrupts();
+	Analyze_Placement();
+	if(bFlight)	Flight_Recorder_Tick();
+
 	if(bLog_CPU_Usage)	Output_Core_Usage();
+	if(bSummary_Requested)	{
+		bSummary_Requested = 0;
+		Write_Summary_File();
+	}
 }
 
+#ifndef NO_X11
 class xtimer {	
 	int dis;
 	int x11_fd;
@@ -247,29 +530,33 @@ public:
 };
 
 xtimer *t;
+#endif
 float tInterval=1.0;
 
+#ifndef NO_NCURSES
 WINDOW * mainwin;
 
-void Run_Terminal_version(void)
+// The SMT layout is fixed for the run, so the terminal loop is instantiated once per layout and picked at start. 
+// N_SMT is 1 or 2 for the detailed columns, 0 for any other number of threads per core (usage only). 
+template <int N_SMT> struct SMT_LAYOUT	{
+	static const int bDetailed = (N_SMT == 1) || (N_SMT == 2);
+	static const int WidthApp = (N_SMT == 1) ? 16 : ((N_SMT == 2) ? 14 : 0);	// (%-12s) or (%-6s)
+	static const int WidthWait = bDetailed ? 5 : 0;	// run-queue wait (%3.2f)
+};
+
+template <int N_SMT> void Run_Terminal_Layout(void)
 {
-    int ch, i, j, iMax, nLine, nCol, cpu_idx, thread_idx, Width=32, WidthApp=0;
+    int ch, i, j, iMax, nLine, nCol, cpu_idx, thread_idx, Width=32, WidthApp=SMT_LAYOUT<N_SMT>::WidthApp, WidthWait=SMT_LAYOUT<N_SMT>::WidthWait, WidthRange=0, WidthIRQ=0, x, iRow, nHot_Listed;
 	time_t t;
 	struct tm tm;
 	char szNull[]="                                                                                         ";
-	char szTime[128], szMonth[8], szDay[8], szHour[8], szMin[8], szSec[8];
+	char szTime[128], szMonth[8], szDay[8], szHour[8], szMin[8], szSec[8], szCore_List[64];
 	struct sigaction act;
 
-	Extract_Thread_Mapping_Info();
-	nCPU = nCore/nThread_per_Core;
-
-	if(nThread_per_Core == 1)	{ // (%-12s)
-		WidthApp = 16 ;
-		Width += WidthApp;
-	}
-	else if(nThread_per_Core == 2)	{ // (%-6s)
-		WidthApp = 14 ;
-		Width += (WidthApp*nThread_per_Core);
+	if(SMT_LAYOUT<N_SMT>::bDetailed)	{
+		if(bSampler)	WidthRange = 10 ;	// min-peak of high frequency samples (%3.2f-%3.2f)
+		if(bIRQ)	WidthIRQ = 11 ;	// interrupt rate and the top source (%5.1fk %s)
+		Width += ((WidthRange+WidthWait+WidthIRQ+WidthApp)*N_SMT);
 	}
 
     if ( (mainwin = initscr()) == NULL ) {
@@ -281,6 +568,8 @@ void Run_Terminal_version(void)
     start_color();
     init_pair(1, COLOR_WHITE, COLOR_BLACK);
     init_pair(2, COLOR_GREEN, COLOR_BLACK);
+    init_pair(3, COLOR_RED, COLOR_BLACK);
+    init_pair(4, COLOR_YELLOW, COLOR_BLACK);
 	attron(COLOR_PAIR(1));
 	
 	if(nCPU <= 32)	{
@@ -301,7 +590,7 @@ void Run_Terminal_version(void)
     act.sa_sigaction = Clean_up;
     act.sa_flags = SA_SIGINFO;
 	
-    if (sigaction(SIGINT, &act, 0)) {
+    if (sigaction(SIGINT, &act, 0) || sigaction(SIGTERM, &act, 0)) {
         perror("Error: sigaction");
         exit(1);
     }
@@ -309,9 +598,10 @@ void Run_Terminal_version(void)
 	usleep(50000);
 	
     while (1) {
-		Enumerate_All_PID();
+		if(bQuit_Requested)	Quit_With_Summary();
+		if(fReplay == NULL)	Enumerate_All_PID();	// app attribution comes from the record file in replay mode
 
-		iMax = nLine + 4;
+		iMax = nLine + 12 + APP_TOP_SHOWN;
 		for(i=1; i<=iMax;i++)	{
 			mvprintw(i, 0, "%s", szNull);	// empty everything. Useful when resizing the terminal
 		}
@@ -329,15 +619,21 @@ void Run_Terminal_version(void)
 		sprintf(szTime, "Now: %s/%s/%d %s:%s:%s on node %s", szMonth, szDay, tm.tm_year + 1900, szHour, szMin, szSec, szHostName);
 		mvprintw(0, 2, "%s", szTime);
 
-		if(nThread_per_Core == 1)	{
+		if(N_SMT == 1)	{
 			for(i=0; i<nCol; i++)	{	// loop over column
 				mvprintw(2, 10 + Width*i, "   T0");
+				if(bSampler)	mvprintw(2, 17 + Width*i, "min-peak");
+				mvprintw(2, 17 + Width*i + WidthRange, "wait");
+				if(bIRQ)	mvprintw(2, 17 + Width*i + WidthRange + WidthWait, "irq/s");
 			}
 		}
-		else if(nThread_per_Core == 2)	{
+		else if(N_SMT == 2)	{
 			for(i=0; i<nCol; i++)	{	// loop over column
-				for(j=0; j<nThread_per_Core; j++)	{
-					mvprintw(2, 10 + Width*i + (5+WidthApp)*j, "   T%d", j);
+				for(j=0; j<N_SMT; j++)	{
+					mvprintw(2, 10 + Width*i + (5+WidthRange+WidthWait+WidthIRQ+WidthApp)*j, "   T%d", j);
+					if(bSampler)	mvprintw(2, 17 + Width*i + (5+WidthRange+WidthWait+WidthIRQ+WidthApp)*j, "min-peak");
+					mvprintw(2, 17 + Width*i + (5+WidthRange+WidthWait+WidthIRQ+WidthApp)*j + WidthRange, "wait");
+					if(bIRQ)	mvprintw(2, 17 + Width*i + (5+WidthRange+WidthWait+WidthIRQ+WidthApp)*j + WidthRange + WidthWait, "irq/s");
 				}
 			}
 		}
@@ -350,41 +646,108 @@ void Run_Terminal_version(void)
 		}
 		
 		for(i=0; i<nCPU; i++)	{
-			if(i % nCore_Socket == 0)	{
+			if(bRow_Socket_Start[i])	{
 				attron(A_BOLD);
 //				attron(A_UNDERLINE);
-				mvprintw(3+(i%nLine), 1+Width*(i/nLine), "Core %3d: ", i);
+				mvprintw(3+(i%nLine), 1+Width*(i/nLine), "Core %3d: ", Row_Label[i]);
 //				mvprintw(3+(i%nLine), 1+Width*(i/nLine), "CORE %3d: ", i);
 //				attroff(A_UNDERLINE);
 				attroff(A_BOLD);
 			}
 			else
-				mvprintw(3+(i%nLine), 1+Width*(i/nLine), "Core %3d: ", i);
+				mvprintw(3+(i%nLine), 1+Width*(i/nLine), "Core %3d: ", Row_Label[i]);
 		}
 		
 		for(i=0; i<nCore; i++)	{
 //			cpu_idx = CoreID[i];
-			cpu_idx = CoreID[i] + SocketID[i]*nCore_Socket;
+			cpu_idx = Row_Core[i];
+			if(cpu_idx < 0)	continue;	// not displayed
 			thread_idx = ThreadID[i];
 
-			if( (nThread_per_Core == 1) || (nThread_per_Core == 2) )	{
+			if(SMT_LAYOUT<N_SMT>::bDetailed)	{
+				x = 12 + (5+WidthRange+WidthWait+WidthIRQ+WidthApp)*thread_idx + Width*(cpu_idx/nLine);
 				if(Core_Usage[i] > 0.02)	attron(COLOR_PAIR(2));	// Use special color for non-idle core.
-				mvprintw(3+(cpu_idx%nLine), 12 + (5+WidthApp)*thread_idx + Width*(cpu_idx/nLine), "%3.2f         ", Core_Usage[i]);
+				mvprintw(3+(cpu_idx%nLine), x, "%3.2f         ", Core_Usage[i]);
 				if(Core_Usage[i] > 0.02)	attron(COLOR_PAIR(1));	// Restore the default color.
-				if(nApp_Core[i] > 0)	{
+				if(bSampler)	{
+					mvprintw(3+(cpu_idx%nLine), x + 5, "%3.2f-%3.2f", Core_Usage_Min[i], Core_Usage_Max[i]);
+				}
+				if(Core_Wait[i] >= 0.01)	{	// my threads were waiting on the run queue of this core
+					attron(COLOR_PAIR(4));
+					mvprintw(3+(cpu_idx%nLine), x + 5 + WidthRange, "%3.2f", Core_Wait[i]);
+					attron(COLOR_PAIR(1));
+				}
+				if(bIRQ)	{
+					if(bIRQ_Hot[i])	attron(COLOR_PAIR(3));	// heavy NIC/storage interrupt traffic on a core running my app
+					mvprintw(3+(cpu_idx%nLine), x + 5 + WidthRange + WidthWait, "%5.1fk %s", 0.001*IRQ_Rate_Total[i], szIRQ_Class[IRQ_Top_Class[i]]);
+					if(bIRQ_Hot[i])	attron(COLOR_PAIR(1));
+				}
+				if(nApp_Core[i] > 1)	{	// oversubscribed. Show the number of busy threads too. 
+					szAppList[i][0][WidthApp-6]=0;
+					if(bOverSub_Core[i] == 2)	attron(COLOR_PAIR(3));	// idle cores are available on the same node
+					mvprintw(3+(cpu_idx%nLine), x + 5 + WidthRange + WidthWait + WidthIRQ, "(%d*%s)", nApp_Core[i], szAppList[i][0]);
+					if(bOverSub_Core[i] == 2)	attron(COLOR_PAIR(1));
+				}
+				else if(nApp_Core[i] > 0)	{
 					szAppList[i][0][WidthApp-4]=0;
-					mvprintw(3+(cpu_idx%nLine), 12 + (5+WidthApp)*thread_idx + Width*(cpu_idx/nLine) + 5, "(%s)", szAppList[i][0]);
+					mvprintw(3+(cpu_idx%nLine), x + 5 + WidthRange + WidthWait + WidthIRQ, "(%s)", szAppList[i][0]);
 //					mvprintw(3+(cpu_idx%nLine), 12 + (5+WidthApp)*thread_idx + Width*(cpu_idx/nLine) + 5, "(%-12s)", szAppList[i][0]);
 				}
 				// add app name info here !!!!!!!!!!!!!!!!!!!
 			}
 			else	{
-				if(Core_Usage[i] > 0.02)	attron(COLOR_PAIR(2));	// Use special color for non-idle core.
+				if(bOverSub_Core[i] == 2)	attron(COLOR_PAIR(3));	// oversubscribed while idle cores are available on the same node
+				else if(Core_Usage[i] > 0.02)	attron(COLOR_PAIR(2));	// Use special color for non-idle core.
 				mvprintw(3+(cpu_idx%nLine), 12 + 5*thread_idx + Width*(cpu_idx/nLine), "%3.2f", Core_Usage[i]);
-				if(Core_Usage[i] > 0.02)	attron(COLOR_PAIR(1));	// Restore the default color.
+				if( (bOverSub_Core[i] == 2) || (Core_Usage[i] > 0.02) )	attron(COLOR_PAIR(1));	// Restore the default color.
+			}
+		}
+		if(nCore_OverSub > 0)	attron(COLOR_PAIR(3));
+		iRow = nLine + 4;	// the rows of summary info
+		mvprintw(iRow++, 2, "Placement: %d cores oversubscribed, %d idle, %.1f migrations/s", nCore_OverSub, nCore_Idle, Migration_Rate);
+		if(nCore_OverSub > 0)	attron(COLOR_PAIR(1));
+		mvprintw(iRow++, 2, "Run-queue wait: %.2f s/s in total, max %.2f on core %d, %.1f us per timeslice", Total_Wait, Max_Wait, Core_Max_Wait, Avg_Wait_Latency);
+		if(bCgroup)	{
+			mvprintw(iRow++, 2, "Cgroup: throttled %d of %d periods, %.3f s/s", Throttled_Periods, Total_Periods, Throttle_Time);
+		}
+		if(bSampler)	{
+			mvprintw(iRow++, 2, "Sampler: %.0f Hz, %.2f%% of a CPU, %.0f us per sample, %llu samples dropped", Sample_Rate, 100.0*Sampler_Load, Sampler_us_per_Sample, __atomic_load_n(&nSample_Dropped, __ATOMIC_RELAXED));
+		}
+		if(bIRQ)	{
+			if(nIRQ_Hot > 0)	attron(COLOR_PAIR(3));
+			mvprintw(iRow, 2, "Interrupt hotspots (app + NET/BLK >= %.0f/s): %d", IRQ_HOT_THRESHOLD, nIRQ_Hot);
+			nHot_Listed = 0;
+			for(j=0; (j<nCore) && (nHot_Listed<8); j++)	{	// list the first few
+				if(bIRQ_Hot[j])	{
+					printw("%s%d", (nHot_Listed == 0) ? ", cores " : " ", j);
+					nHot_Listed++;
+				}
+			}
+			if(nIRQ_Hot > nHot_Listed)	printw(" ...");
+			if(nIRQ_Hot > 0)	attron(COLOR_PAIR(1));
+			iRow++;
+		}
+		if(bFlight)	{
+			if(nPost_Left > 0)	attron(COLOR_PAIR(4));
+			mvprintw(iRow, 2, "Flight recorder: %d dumps", nFlight_Dump);
+			if(nPost_Left > 0)	printw(", triggered (%s), %d frames to go", szFlight_Reason, nPost_Left);
+			else if(szFlight_Last[0])	printw(", last %s", szFlight_Last);
+			if(nPost_Left > 0)	attron(COLOR_PAIR(1));
+			iRow++;
+		}
+		if( (fReplay == NULL) && (nTop_App > 0) )	{	// ranked panel. Not in record files. 
+			mvprintw(iRow++, 2, "Top apps: %.2f cores used by my threads in total", Total_App_CPU);
+			for(j=0; (j<nTop_App) && (j<APP_TOP_SHOWN); j++)	{
+				Format_Core_List(Top_App[j].bCore, szCore_List, 28);
+				mvprintw(iRow++, 4, "%d. %-15s %6.2f cores %5d thr %4d proc  on %s", j+1, Top_App[j].szName, Top_App[j].CPU, Top_App[j].nThread, Top_App[j].nProc, (szCore_List[0]) ? szCore_List : "-");
+			}
+			mvprintw(iRow, 2, "Top processes:");
+			for(j=0; (j<nTop_Proc) && (j<3); j++)	{
+				printw(" %d(%s) %.2f", Top_Proc[j].pid, Top_Proc[j].szName, Top_Proc[j].CPU);
 			}
+			iRow++;
 		}
-		mvprintw(nLine+5, 2, "Use Ctrl+c to quit.");
+		mvprintw(iRow, 2, "Use Ctrl+c to quit.");
 		mvprintw(0, 0, "");
 		refresh();
 		usleep((int)(1000000*tInterval));
@@ -393,61 +756,48 @@ void Run_Terminal_version(void)
     return;
 }
 
-int main(int argc, char *argv[]) {
-	int Run=1, GUI_On=1;
-	XEvent ev;
-	char *szEnv_Log_CPU_Usage;
-	
-	if(argc >= 2)	{
-		if( (argv[1][0] >= '0') && (argv[1][0] <= '9') )	{
-			tInterval = atof(argv[1]);
-			if( argc >= 3 )	{
-				if(strcmp(argv[2], "txt")==0)	{
-					GUI_On = 0;
-				}
-			}
-		}
-		else if( strcmp(argv[1], "txt")==0 )	{
-			GUI_On = 0;
-			if( argc >= 3 ) {
-				if( (argv[2][0] >= '0') && (argv[2][0] <= '9') )        {
-					tInterval = atof(argv[2]);
-				}
-			}
-		}
+void Run_Terminal_version(void)
+{
+	if(nThread_per_Core == 1)	Run_Terminal_Layout<1>();
+	else if(nThread_per_Core == 2)	Run_Terminal_Layout<2>();
+	else	Run_Terminal_Layout<0>();
+}
+#endif
+
+void Run_Headless_version(void)	// no display. The output is the log, the record file, flight dumps and the summary table. 
+{
+	struct sigaction act;
+
+	memset(&act, 0, sizeof(act));
+	act.sa_sigaction = Clean_up;
+	act.sa_flags = SA_SIGINFO;
+	if (sigaction(SIGINT, &act, 0) || sigaction(SIGTERM, &act, 0)) {
+		perror("Error: sigaction");
+		exit(1);
 	}
-	if(GUI_On == 0) printf("To run the console version after one second.\n");	
 
-	szEnv_Log_CPU_Usage = getenv("LOG_CORE_USAGE");
-	if(szEnv_Log_CPU_Usage)	{
-		if( (strcmp(szEnv_Log_CPU_Usage,"1")==0) || (strcmp(szEnv_Log_CPU_Usage,"YES")==0) || (strcmp(szEnv_Log_CPU_Usage,"ON")==0) )	{
-			bLog_CPU_Usage = 1;
-		}
+	while(1)	{
+		usleep((int)(1000000*tInterval));	// first, so the counters advance past the snapshot taken in main()
+		if(bQuit_Requested)	Quit_With_Summary();
+		if(fReplay == NULL)	Enumerate_All_PID();
+		Cal_Core_Usage();
 	}
+}
 
-	Init_Core_Stat();
-	Read_Proc_Stat();
-	Setup_bar_width();
-	
-	gethostname(szHostName, 255);
+#ifndef NO_X11
+void Run_GUI_version(void)
+{
+	int Run=1, x11_fd;
+	XEvent ev;
+	fd_set in_fds;
+	struct sigaction act;
 
-	my_pid = getpid();
-	my_uid = getuid();
-	
-	dis = XOpenDisplay(NULL);
-	if( (dis == NULL) || (GUI_On == 0) )	{
-		if(dis == NULL) printf("Fail to open DISPLAY. Did you set up X11 forwarding?\nThe terminal version will run.\n");
-		sleep(1);
-		Run_Terminal_version();
-		return 0;
-	}
-	
 	//	printf("display = %x\n", dis);
 	screen = DefaultScreen(dis);
 	//	printf("screen = %x\n", screen);
-	win_width = bar_width*(nCore-1)+2*extra;
-	win_height = bar_height+2*extra;
-	win = XCreateSimpleWindow(dis, RootWindow(dis, 0), 1, 1, bar_width*(nCore-1)+2*extra, bar_height+2*extra, \
+	win_width = bar_width*(nCore_Shown-1)+2*extra;
+	win_height = bar_height+2*extra+APP_LEGEND_HEIGHT;
+	win = XCreateSimpleWindow(dis, RootWindow(dis, 0), 1, 1, win_width, win_height, \
         0, WhitePixel(dis, 0), WhitePixel(dis, 0));
 	
     // You don't need all of these. Make the mask as you normally would.
@@ -464,13 +814,27 @@ int main(int argc, char *argv[]) {
 	XFlush(dis);
 	
 	t=new xtimer(dis,tInterval,timerFired);
+
+	memset(&act, 0, sizeof(act));
+	act.sa_sigaction = Clean_up;	// print the summary table on Ctrl-C as well
+	act.sa_flags = SA_SIGINFO;
+	sigaction(SIGINT, &act, 0);
+	sigaction(SIGTERM, &act, 0);
 	
     // Main loop
-	while(Run) {
+	while(Run && (bQuit_Requested == 0)) {
 		t->check(); // this blocks till time runs out or Xevent comes
 		
 		// Handle XEvents and flush the input, if timers stopped block for next event (probably map!)
 		while(XPending(dis) || t->running()==0) {
+			if(bQuit_Requested)	break;
+			if(XPending(dis) == 0)	{	// unmapped. Wait in select() instead of XNextEvent(), so a signal wakes it up. 
+				x11_fd = ConnectionNumber(dis);
+				FD_ZERO(&in_fds);
+				FD_SET(x11_fd, &in_fds);
+				select(x11_fd+1, &in_fds, 0, 0, NULL);
+				continue;
+			}
 			XNextEvent(dis, &ev);
 			if (ev.type==UnmapNotify) { t->disable(); }
 			else if (ev.type==MapNotify) { t->enable(); }
@@ -480,6 +844,171 @@ int main(int argc, char *argv[]) {
 			}
 		}
 	}
+	Quit_With_Summary();	// the window is closed or a signal arrived
+}
+#endif
+
+const char *szKeyword[]={"txt", "headless", "record", "replay", "speed", "sample", "uring", "bench_scan", "trigger", "window", "irq", "cgroup", NULL};	// all parameters of main()
+
+int Is_Keyword(char szArg[])
+{
+	int i;
+
+	for(i=0; szKeyword[i]; i++)	{
+		if(strcmp(szArg, szKeyword[i]) == 0)	return 1;
+	}
+	return 0;
+}
+
+int main(int argc, char *argv[]) {
+	int i, GUI_On=1, bHeadless=0, bUse_Cgroup=0, bUse_Uring=0, nBench_Scan=0;
+	struct sigaction act;
+	char *szEnv_Log_CPU_Usage, *szRecordFile=NULL, *szReplayFile=NULL, *szCgroupPath=NULL;
+	
+	for(i=1; i<argc; i++)	{
+		if( (argv[i][0] >= '0') && (argv[i][0] <= '9') )	{
+			tInterval = atof(argv[i]);
+		}
+		else if( strcmp(argv[i], "txt")==0 )	{
+			GUI_On = 0;
+		}
+		else if( strcmp(argv[i], "headless")==0 )	{
+			bHeadless = 1;
+		}
+		else if( (strcmp(argv[i], "record")==0) && (i+1 < argc) )	{
+			szRecordFile = argv[++i];
+		}
+		else if( (strcmp(argv[i], "replay")==0) && (i+1 < argc) )	{
+			szReplayFile = argv[++i];
+		}
+		else if( (strcmp(argv[i], "speed")==0) && (i+1 < argc) )	{	// replay speed. A bare number is always the interval. 
+			i++;
+			if(strcmp(argv[i], "max")==0)	{
+				Replay_Speed = 0.0;
+			}
+			else if( (argv[i][0] >= '0') && (argv[i][0] <= '9') && (atof(argv[i]) > 0.0) )	{
+				Replay_Speed = atof(argv[i]);
+			}
+			else	{
+				printf("Invalid replay speed: %s\nExpected a positive factor or max\nQuit\n", argv[i]);
+				exit(1);
+			}
+		}
+		else if( strcmp(argv[i], "sample")==0 )	{
+			bSampler = 1;
+			if( (i+1 < argc) && (argv[i+1][0] >= '0') && (argv[i+1][0] <= '9') )	{	// optional sampling period
+				tSample = atof(argv[++i]);
+				if(tSample < 0.001)	tSample = 0.001;
+			}
+		}
+		else if( strcmp(argv[i], "uring")==0 )	{
+			bUse_Uring = 1;
+		}
+		else if( strcmp(argv[i], "bench_scan")==0 )	{
+			nBench_Scan = 20;
+			if( (i+1 < argc) && (argv[i+1][0] >= '0') && (argv[i+1][0] <= '9') )	{	// optional number of scans
+				nBench_Scan = atoi(argv[++i]);
+			}
+		}
+		else if( (strcmp(argv[i], "trigger")==0) && (i+1 < argc) )	{
+			if(Parse_Trigger_Rules(argv[++i]) == 0)	{
+				printf("Invalid trigger rules. Expected a list of idle[=usage], socket[=usage] and share[=n_threads], e.g., idle=0.1,socket=0.95,share\nQuit\n");
+				exit(1);
+			}
+			bFlight = 1;
+		}
+		else if( (strcmp(argv[i], "window")==0) && (i+1 < argc) )	{	// frames kept before and after a trigger
+			if( (sscanf(argv[++i], "%d,%d", &Flight_Pre, &Flight_Post) != 2) || (Flight_Pre < 0) || (Flight_Post < 0) || (Flight_Pre + Flight_Post + 1 > MAX_FLIGHT_FRAME) )	{
+				printf("Invalid window: %s\nExpected <pre>,<post> in frames with pre + post < %d\nQuit\n", argv[i], MAX_FLIGHT_FRAME);
+				exit(1);
+			}
+		}
+		else if( strcmp(argv[i], "irq")==0 )	{
+			bIRQ = 1;
+		}
+		else if( strcmp(argv[i], "cgroup")==0 )	{
+			bUse_Cgroup = 1;
+			if(i+1 < argc)	{	// optional cgroup path. Discover my own cgroup without it. 
+				if( ( (argv[i+1][0] < '0') || (argv[i+1][0] > '9') ) && (Is_Keyword(argv[i+1]) == 0) )	{
+					szCgroupPath = argv[++i];
+				}
+			}
+		}
+		else	{
+			printf("Unknown parameter: %s\n", argv[i]);
+		}
+	}
+#ifdef NO_X11
+	GUI_On = 0;
+#endif
+#ifdef NO_NCURSES
+	bHeadless = 1;
+#endif
+	if( (GUI_On == 0) && (bHeadless == 0) ) printf("To run the console version after one second.\n");	
+
+	szEnv_Log_CPU_Usage = getenv("LOG_CORE_USAGE");
+	if(szEnv_Log_CPU_Usage)	{
+		if( (strcmp(szEnv_Log_CPU_Usage,"1")==0) || (strcmp(szEnv_Log_CPU_Usage,"YES")==0) || (strcmp(szEnv_Log_CPU_Usage,"ON")==0) )	{
+			bLog_CPU_Usage = 1;
+		}
+	}
+
+	Init_Core_Stat();
+	gethostname(szHostName, 255);
+	for(i=0; i<MAX_CORE; i++)	{
+		bCore_Shown[i] = 1;
+	}
+
+	if(szReplayFile)	{
+		Open_Replay_File(szReplayFile);	// nCore, topology and host name come from the record file
+	}
+	else	{
+		Read_Proc_Stat();
+		Extract_Thread_Mapping_Info();
+		Read_NUMA_Node_Info();
+		if(bUse_Cgroup)	Setup_Cgroup(szCgroupPath);
+		if(szRecordFile)	Open_Record_File(szRecordFile);
+		if(bSampler)	Start_Sampler();
+		if(bIRQ)	Init_Interrupt_Stat();
+		if(bUse_Uring)	{
+			bUring = Init_Uring();
+			if(bUring == 0)	printf("io_uring is not available. Use the plain syscall path.\n");
+		}
+	}
+	Setup_Core_Layout();
+	Setup_bar_width();
+	if(bFlight)	Init_Flight_Recorder();
+
+	my_pid = getpid();
+	my_uid = getuid();
+	nClock_Tick = sysconf(_SC_CLK_TCK);
+	memset(&act, 0, sizeof(act));
+	act.sa_handler = Request_Summary;	// "kill -USR1 <pid>" writes the summary table to a file
+	sigaction(SIGUSR1, &act, 0);
+
+	if( (nBench_Scan > 0) && (fReplay == NULL) )	{
+		Bench_Scan(nBench_Scan);
+		return 0;
+	}
+	
+	if(bHeadless)	{
+		Run_Headless_version();
+		return 0;
+	}
+#ifndef NO_X11
+	if(GUI_On)	{
+		dis = XOpenDisplay(NULL);
+		if(dis)	{
+			Run_GUI_version();
+			return(0);
+		}
+		printf("Fail to open DISPLAY. Did you set up X11 forwarding?\nThe terminal version will run.\n");
+	}
+#endif
+#ifndef NO_NCURSES
+	sleep(1);
+	Run_Terminal_version();
+#endif
 	return(0);
 }
 
@@ -493,6 +1022,7 @@ void Format_Two_Digital(int number, char szBuf[])
 	}
 }
 
+#ifndef NO_X11
 void DrawLines(void)
 {
 	char szCoreIdx[5][64]={"0", "xx", "xx", "xx", "271"};
@@ -507,42 +1037,43 @@ void DrawLines(void)
 	int nBufLen;
 	
 	line_list[0].x1 = extra;					line_list[0].y1 = bar_height+extra;	
-	line_list[0].x2 = extra+bar_width*nCore;	line_list[0].y2 = bar_height+extra;	
+	line_list[0].x2 = extra+bar_width*nCore_Shown;	line_list[0].y2 = bar_height+extra;	
 	
 	line_list[1].x1 = extra;					line_list[1].y1 = bar_height+extra;	
 	line_list[1].x2 = extra;					line_list[1].y2 = extra;
 	
 	line_list[2].x1 = extra;					line_list[2].y1 = extra;	
-	line_list[2].x2 = extra+bar_width*nCore;	line_list[2].y2 = extra;	
+	line_list[2].x2 = extra+bar_width*nCore_Shown;	line_list[2].y2 = extra;	
 	
 	line_list[3].x1 = extra;					line_list[3].y1 = extra+bar_height*0.5;	
-	line_list[3].x2 = extra+bar_width*nCore;	line_list[3].y2 = extra+bar_height*0.5;	
+	line_list[3].x2 = extra+bar_width*nCore_Shown;	line_list[3].y2 = extra+bar_height*0.5;	
 	
 	XSetForeground(dis, gc, 0x0);
 	
 	XDrawSegments(dis, win, gc, line_list, 4);
 	
-	nMid = (int)((nCore-1)/2);
+	nMid = (int)((nCore_Shown-1)/2);
 	nMid_L = (int)((nMid)/2);
-	nMid_R = (int)((nCore-1+nMid)/2);
-	sprintf(szCoreIdx[1], "%d", nMid_L);
-	sprintf(szCoreIdx[2], "%d", nMid);
-	sprintf(szCoreIdx[3], "%d", nMid_R);
-	sprintf(szCoreIdx[4], "%d", nCore-1);
+	nMid_R = (int)((nCore_Shown-1+nMid)/2);
+	sprintf(szCoreIdx[0], "%d", Core_Shown_List[0]);	// the real core index. Cores outside the monitored cpuset are skipped. 
+	sprintf(szCoreIdx[1], "%d", Core_Shown_List[nMid_L]);
+	sprintf(szCoreIdx[2], "%d", Core_Shown_List[nMid]);
+	sprintf(szCoreIdx[3], "%d", Core_Shown_List[nMid_R]);
+	sprintf(szCoreIdx[4], "%d", Core_Shown_List[nCore_Shown-1]);
 	XDrawString(dis, win, gc, extra, extra+bar_height+14, szCoreIdx[0], strlen(szCoreIdx[0]));
 	
-	if(nCore>4) XDrawString(dis, win, gc, extra+(int)((nMid_L-1+0.5)*bar_width), extra+bar_height+14, szCoreIdx[1], strlen(szCoreIdx[1]));
-	if(nCore>2) XDrawString(dis, win, gc, extra+(int)((nMid-1+0.5)*bar_width), extra+bar_height+14, szCoreIdx[2], strlen(szCoreIdx[2]));
-	if(nCore>4) XDrawString(dis, win, gc, extra+(int)((nMid_R-1+0.5)*bar_width), extra+bar_height+14, szCoreIdx[3], strlen(szCoreIdx[3]));
+	if(nCore_Shown>4) XDrawString(dis, win, gc, extra+(int)((nMid_L-1+0.5)*bar_width), extra+bar_height+14, szCoreIdx[1], strlen(szCoreIdx[1]));
+	if(nCore_Shown>2) XDrawString(dis, win, gc, extra+(int)((nMid-1+0.5)*bar_width), extra+bar_height+14, szCoreIdx[2], strlen(szCoreIdx[2]));
+	if(nCore_Shown>4) XDrawString(dis, win, gc, extra+(int)((nMid_R-1+0.5)*bar_width), extra+bar_height+14, szCoreIdx[3], strlen(szCoreIdx[3]));
 	
-	if(nCore>1) XDrawString(dis, win, gc, extra+(int)((nCore-0.5)*bar_width), extra+bar_height+14, szCoreIdx[4], strlen(szCoreIdx[4]));
+	if(nCore_Shown>1) XDrawString(dis, win, gc, extra+(int)((nCore_Shown-0.5)*bar_width), extra+bar_height+14, szCoreIdx[4], strlen(szCoreIdx[4]));
 	
 	
 	XDrawString(dis, win, gc, extra-13, extra+bar_height+4, szUsage[0], strlen(szUsage[0]));
 	XDrawString(dis, win, gc, extra-19, extra+bar_height*0.5+4, szUsage[1], strlen(szUsage[1]));
 	XDrawString(dis, win, gc, extra-25, extra+6, szUsage[2], strlen(szUsage[2]));
 	
-	XDrawString(dis, win, gc, extra+(int)((nCore-0.5)*bar_width-20), extra+bar_height+32, szAxis[0], strlen(szAxis[0]));	// X-Axis info
+	XDrawString(dis, win, gc, extra+(int)((nCore_Shown-0.5)*bar_width-20), extra+bar_height+32, szAxis[0], strlen(szAxis[0]));	// X-Axis info
 	XDrawString(dis, win, gc, extra-30, extra-15, szAxis[1], strlen(szAxis[1]));	// Y-Axis info
 	
 	Format_Two_Digital(tm.tm_mon + 1, szMonth);
@@ -558,21 +1089,68 @@ void DrawLines(void)
 
 void timerFired()
 {
-	int i, height;
+	int i, k, y, height, height_wait;
+	char szPlacement[256], szCore_List[64];
 	
+	if(fReplay == NULL)	Enumerate_All_PID();
 	Cal_Core_Usage();
 	
 	XSetForeground(dis, gc, 0xFFFFFF);
 	XFillRectangle(dis, win, gc, 0, 0, win_width, win_height);
 	
-	XSetForeground(dis, gc, 0xFF);
-	
-	for(i=0; i<nCore; i++)	{
+	for(k=0; k<nCore_Shown; k++)	{
+		i = Core_Shown_List[k];
+		if(bOverSub_Core[i] == 2)	XSetForeground(dis, gc, 0xFF0000);	// oversubscribed while idle cores are available on the same node
+		else if(bOverSub_Core[i] == 1)	XSetForeground(dis, gc, 0xFF8000);
+		else	XSetForeground(dis, gc, 0xFF);
 		height = (int)(bar_height * Core_Usage[i]);
-		XFillRectangle(dis, win, gc, extra+i*bar_width, extra+(bar_height-height), bar_width, height);
+		XFillRectangle(dis, win, gc, extra+k*bar_width, extra+(bar_height-height), bar_width, height);
+		if(Core_Wait[i] >= 0.01)	{	// stack run-queue wait on top of the usage bar
+			height_wait = (int)(bar_height * Core_Wait[i]);
+			if(height_wait > (bar_height-height))	height_wait = bar_height-height;
+			XSetForeground(dis, gc, 0xE0C000);
+			XFillRectangle(dis, win, gc, extra+k*bar_width, extra+(bar_height-height-height_wait), bar_width, height_wait);
+		}
+		if( (Core_Top_App[i] >= 0) && (Core_Top_App[i] < nTop_App) && (Core_Top_App[i] < APP_TOP_SHOWN) )	{	// which top app runs on this core
+			XSetForeground(dis, gc, App_Color[Core_Top_App[i]]);
+			XFillRectangle(dis, win, gc, extra+k*bar_width, extra+bar_height+1, bar_width, 3);
+		}
+		if(bIRQ && bIRQ_Hot[i])	{	// mark heavy NIC/storage interrupt traffic on a core running my app
+			XSetForeground(dis, gc, 0xC000C0);
+			XFillRectangle(dis, win, gc, extra+k*bar_width, extra-5, bar_width, 4);
+		}
+		if(bSampler)	{	// marks of the peak and min of high frequency samples since last frame
+			XSetForeground(dis, gc, 0x0);
+			XDrawLine(dis, win, gc, extra+k*bar_width, extra+bar_height-(int)(bar_height*Core_Usage_Max[i]), extra+(k+1)*bar_width-1, extra+bar_height-(int)(bar_height*Core_Usage_Max[i]));
+			XSetForeground(dis, gc, 0x00A000);
+			XDrawLine(dis, win, gc, extra+k*bar_width, extra+bar_height-(int)(bar_height*Core_Usage_Min[i]), extra+(k+1)*bar_width-1, extra+bar_height-(int)(bar_height*Core_Usage_Min[i]));
+		}
 	}
 	DrawLines();
+
+	sprintf(szPlacement, "Placement: %d cores oversubscribed, %d idle, %.1f migrations/s", nCore_OverSub, nCore_Idle, Migration_Rate);
+	if(bSampler)	sprintf(szPlacement+strlen(szPlacement), ". Sampler: %.0f Hz, %.2f%% of a CPU, %llu dropped", Sample_Rate, 100.0*Sampler_Load, __atomic_load_n(&nSample_Dropped, __ATOMIC_RELAXED));
+	if(bIRQ)	sprintf(szPlacement+strlen(szPlacement), ". Interrupt hotspots: %d", nIRQ_Hot);
+	if(bFlight)	sprintf(szPlacement+strlen(szPlacement), ". Flight dumps: %d%s", nFlight_Dump, (nPost_Left > 0) ? " (triggered)" : "");
+	XSetForeground(dis, gc, (nCore_OverSub > 0) ? 0xFF0000 : 0x0);
+	XDrawString(dis, win, gc, max((int)(0.2*win_width), 100), extra-12, szPlacement, strlen(szPlacement));
+
+	sprintf(szPlacement, "Run-queue wait: %.2f s/s, max %.2f on core %d, %.1f us per timeslice", Total_Wait, Max_Wait, Core_Max_Wait, Avg_Wait_Latency);
+	if(bCgroup)	sprintf(szPlacement+strlen(szPlacement), ". Cgroup throttled %d of %d periods", Throttled_Periods, Total_Periods);
+	XSetForeground(dis, gc, 0x0);
+	XDrawString(dis, win, gc, extra, extra+bar_height+48, szPlacement, strlen(szPlacement));
+
+	for(k=0; (k<nTop_App) && (k<APP_TOP_SHOWN) && (fReplay == NULL); k++)	{	// legend of the top apps
+		y = extra+bar_height+48+14*(k+1);
+		XSetForeground(dis, gc, App_Color[k]);
+		XFillRectangle(dis, win, gc, extra, y-9, 10, 10);
+		Format_Core_List(Top_App[k].bCore, szCore_List, 64);
+		snprintf(szPlacement, sizeof(szPlacement), "%.*s: %.2f cores, %d threads, %d processes, busy on %s", MAX_APP_NAME_LEN, Top_App[k].szName, Top_App[k].CPU, Top_App[k].nThread, Top_App[k].nProc, (szCore_List[0]) ? szCore_List : "-");
+		XSetForeground(dis, gc, 0x0);
+		XDrawString(dis, win, gc, extra+14, y, szPlacement, strlen(szPlacement));
+	}
 }
+#endif
 
 void Init_Core_Stat()
 {
@@ -742,143 +1320,1874 @@ void Extract_Thread_Mapping_Info(void)
 	fclose(fIn);
 
 	nSocket = MaxSocket + 1; 
+	if(nCore_Socket <= 0)	nCore_Socket = nCore;	// "cpu cores" is not available (e.g., in some VMs)
+	if(nThread_Socket <= 0)	nThread_Socket = nCore_Socket;
 	nThread_per_Core = nThread_Socket / nCore_Socket;
 
 	return;
 }
 
-static void Clean_up(int sig, siginfo_t *siginfo, void *ptr)
+void Open_Record_File(char szName[])
 {
-	//	usleep(1500000);
-    delwin(mainwin);
-    endwin();
-    refresh();
-	
-	exit(0);
+	char Header_Buf[MAX_HEADER_SIZE];
+
+	fRecord = fopen(szName, "wb");
+	if(fRecord == NULL)	{
+		printf("Fail to open file: %s\nQuit\n", szName);
+		exit(1);
+	}
+
+	fwrite(Header_Buf, 1, Serialize_Header(Header_Buf), fRecord);
+
+	gettimeofday(&tv_Record_Start, 0);
+	Write_Record_Frame();	// the initial snapshot. Replay uses it as the baseline. 
 }
 
-int Get_Logic_Core_ID(int Phys_Cores_on_Socket[], int Phys_Core_ID, int& Thread)
+void Write_Record_Frame(void)
 {
-	int i=0, Logic_ID=-1;
+	struct timeval tv_Now, tv_Diff;
 
-	Thread=-1;
+	gettimeofday(&tv_Now, 0);
+	timersub(&tv_Now, &tv_Record_Start, &tv_Diff);
 
-	while(Phys_Cores_on_Socket[i] != (-1) )	{
-		if(Phys_Cores_on_Socket[i] == Phys_Core_ID)	{
-			Thread++;
-			if( Logic_ID == (-1) )	{	// set logic core id
-				Logic_ID = i;
-			}
-		}
-		i++;
-		if(i>=MAX_CORE)	{
-			printf("i>=MAX_CORE in Get_Logic_Core_ID(). Must be something wrong.\n");
-			break;
-		}
-	}
-	
-	if( Thread == (-1) )	Logic_ID = i;	// the count of logic cores
-	Phys_Cores_on_Socket[i] = Phys_Core_ID;	// insert the new physical core id
-	Thread++;	// the first thread
+	fwrite(Frame_Buf, 1, Serialize_Frame(Frame_Buf, tv_Diff.tv_sec + 0.000001*tv_Diff.tv_usec), fRecord);
+	fflush(fRecord);	// keep the file usable if the job is killed
+}
 
-	return Logic_ID;
+int Serialize_Header(char *pBuf)	// the header and the topology of a record file. Return the number of bytes. 
+{
+	RECORD_HEADER Header;
+	int nLen=0;
+
+	memset(&Header, 0, sizeof(RECORD_HEADER));
+	strcpy(Header.szMagic, RECORD_MAGIC);
+	Header.nCore = nCore;
+	Header.nSocket = nSocket;
+	Header.nCore_Socket = nCore_Socket;
+	Header.nThread_per_Core = nThread_per_Core;
+	Header.tInterval = tInterval;
+	memcpy(Header.szHostName, szHostName, sizeof(Header.szHostName)-1);	// the header is zeroed, so the name stays terminated
+
+	memcpy(pBuf+nLen, &Header, sizeof(RECORD_HEADER));	nLen += sizeof(RECORD_HEADER);
+	memcpy(pBuf+nLen, SocketID, sizeof(int)*nCore);	nLen += sizeof(int)*nCore;
+	memcpy(pBuf+nLen, CoreID, sizeof(int)*nCore);	nLen += sizeof(int)*nCore;
+	memcpy(pBuf+nLen, ThreadID, sizeof(int)*nCore);	nLen += sizeof(int)*nCore;
+	memcpy(pBuf+nLen, NodeID, sizeof(int)*nCore);	nLen += sizeof(int)*nCore;
+	memcpy(pBuf+nLen, bCore_Shown, sizeof(int)*nCore);	nLen += sizeof(int)*nCore;	// the cpuset of the monitored cgroup
+	return nLen;
 }
 
-void Enumerate_All_PID(void)	// exhaustively enumerate all PIDs
+int Serialize_Frame(char *pBuf, double t)	// the current counters and app attribution. Return the number of bytes. 
 {
-	DIR *dp, *dp_task;
-	struct dirent *ep, *ep_task;
-	char szPath[512], szPath_Child[512], szExeName[512], szMsg[256], c;
-	struct stat file_stat;
-	int pid, tid, thread_count, core;
-	int IsThreadRunning;
-	float utime;
+	RECORD_FRAME Frame;
+	RECORD_APP_CORE App_Core;
+	int i, nLen=0, nName;
 
-	memset(nApp_Core, 0, sizeof(int)*MAX_CORE);
+	Frame.t = t;
+	Frame.nCore_App = 0;
+	for(i=0; i<nCore; i++)	{
+		if(nApp_Core[i] > 0)	Frame.nCore_App++;
+	}
+	Frame.Core_Max_Wait = Core_Max_Wait;
+	Frame.Migration_Rate = Migration_Rate;
+	Frame.Total_Wait = Total_Wait;
+	Frame.Max_Wait = Max_Wait;
+	Frame.Avg_Wait_Latency = Avg_Wait_Latency;
+	memcpy(pBuf+nLen, &Frame, sizeof(RECORD_FRAME));	nLen += sizeof(RECORD_FRAME);
+
+	memcpy(pBuf+nLen, cur_user, sizeof(unsigned long long)*nCore);	nLen += sizeof(unsigned long long)*nCore;
+	memcpy(pBuf+nLen, cur_nice, sizeof(unsigned long long)*nCore);	nLen += sizeof(unsigned long long)*nCore;
+	memcpy(pBuf+nLen, cur_system, sizeof(unsigned long long)*nCore);	nLen += sizeof(unsigned long long)*nCore;
+	memcpy(pBuf+nLen, cur_idle, sizeof(unsigned long long)*nCore);	nLen += sizeof(unsigned long long)*nCore;
+	memcpy(pBuf+nLen, cur_iowait, sizeof(unsigned long long)*nCore);	nLen += sizeof(unsigned long long)*nCore;
+	memcpy(pBuf+nLen, cur_irq, sizeof(unsigned long long)*nCore);	nLen += sizeof(unsigned long long)*nCore;
+	memcpy(pBuf+nLen, cur_softirq, sizeof(unsigned long long)*nCore);	nLen += sizeof(unsigned long long)*nCore;
+	memcpy(pBuf+nLen, cur_steal, sizeof(unsigned long long)*nCore);	nLen += sizeof(unsigned long long)*nCore;
 
-//	printf("pid     Exe_Name             tid     Affinity\n", pid, szExeName);
-	
-	dp = opendir("/proc");
-	if (dp != NULL)	{
-		while (ep = readdir (dp))	{
-			sprintf(szPath, "/proc/%s", ep->d_name);
-			c = ep->d_name[0];
-			if( (c < '0') || (c > '9') )	continue;	// not starting with a number
-			
-			pid = atoi(ep->d_name);
-			
-			if(stat(szPath, &file_stat) == -1)	continue;	// error
-			if(pid == my_pid)	continue;	// skip checking my tools itself
-			
-			if(file_stat.st_uid == my_uid)	{	// build the list of my jobs
-				thread_count = 0;
-				Extract_Exec_Name(pid, szExeName, &core, &utime);
-				sprintf(szMsg, "%-6d  %-15s     ", pid, szExeName);
-				sprintf(szPath, "/proc/%d/task", pid);
-				dp_task = opendir(szPath);
-				if (dp_task != NULL)	{
-					while( ep_task = readdir (dp_task) )	{
-						c = ep_task->d_name[0];
-						if( (c < '0') || (c > '9') )	continue;	// not starting with a number
-						
-						tid = atoi(ep_task->d_name);
-						sprintf(szPath_Child, "/proc/%s/stat", ep_task->d_name);
-						IsThreadRunning = Is_Thread_Running(szPath_Child);
-						if(IsThreadRunning)	{
-							Extract_Exec_Name(tid, szExeName, &core, &utime);
-							if(utime > 1.0)	{	// larger than 1 s. 
-								strncpy(szAppList[core][nApp_Core[core]], szExeName, MAX_APP_NAME_LEN);
-								nApp_Core[core]++;
-								thread_count++;
-							}
-						}
+	for(i=0; i<nCore; i++)	{
+		if(nApp_Core[i] == 0)	continue;
+		App_Core.core = i;
+		App_Core.nApp = nApp_Core[i];
+		App_Core.Wait = Core_Wait[i];
+		App_Core.Wait_Latency = Core_Wait_Latency[i];
+		memcpy(pBuf+nLen, &App_Core, sizeof(RECORD_APP_CORE));	nLen += sizeof(RECORD_APP_CORE);
+		nName = (nApp_Core[i] < MAX_APP) ? nApp_Core[i] : MAX_APP;
+		memcpy(pBuf+nLen, szAppList[i], MAX_APP_NAME_LEN*nName);	nLen += MAX_APP_NAME_LEN*nName;
+	}
+	return nLen;
+}
 
-					}
-					closedir(dp_task);
-				}
-				else
-					perror ("Couldn't open the directory");
-			}
+int Parse_Trigger_Rules(char szRules[])	// e.g., "idle=0.1,socket=0.95,share=2". Return 0 if invalid. 
+{
+	char *pch, *pValue;
+
+	for(pch=strtok(szRules, ","); pch; pch=strtok(NULL, ","))	{
+		pValue = strchr(pch, '=');
+		if(pValue)	*(pValue++) = 0;
+		if(strcmp(pch, "idle") == 0)	{	// a core running my app drops below the threshold
+			bRule_Idle = 1;
+			if(pValue)	Idle_Threshold = atof(pValue);
+		}
+		else if(strcmp(pch, "socket") == 0)	{	// the average usage of a socket reaches the threshold
+			bRule_Socket = 1;
+			if(pValue)	Socket_Threshold = atof(pValue);
+		}
+		else if(strcmp(pch, "share") == 0)	{	// a core is shared by this many busy threads of mine
+			bRule_Share = 1;
+			if(pValue)	Share_Threshold = atoi(pValue);
+			if(Share_Threshold < 2)	Share_Threshold = 2;
+		}
+		else	{
+			return 0;
 		}
-		closedir(dp);
 	}
-	else
-		perror ("Couldn't open the directory");
-	
-//	printf("nJob = %d  nMyJob = %d\n", nJobs, nMyJob);
+	return (bRule_Idle || bRule_Socket || bRule_Share);
 }
 
-#define SIZE_STAT	(360)
+void Init_Flight_Recorder(void)	// allocate the ring for the pre- and post-trigger window
+{
+	nFlight_Slot = Flight_Pre + 1 + Flight_Post;
+	Flight_Slot_Size = sizeof(RECORD_FRAME) + 8*sizeof(unsigned long long)*nCore + nCore*(sizeof(RECORD_APP_CORE) + MAX_APP*MAX_APP_NAME_LEN);
+	Flight_Ring = (char *)malloc((size_t)nFlight_Slot * Flight_Slot_Size);
+	Flight_Len = (int *)malloc(sizeof(int)*nFlight_Slot);
+	if( (Flight_Ring == NULL) || (Flight_Len == NULL) )	{
+		printf("Fail to allocate memory for the flight recorder.\nQuit\n");
+		exit(1);
+	}
+	memset(bApp_Last, 0, sizeof(int)*MAX_CORE);
+	gettimeofday(&tv_Flight_Start, 0);
+	printf("Flight recorder: %d frames before and %d frames after a trigger, %.1f MB in memory.\n", Flight_Pre, Flight_Post, 1.0E-6*nFlight_Slot*Flight_Slot_Size);
+}
 
-void Extract_Exec_Name(int pid, char szExeName[], int* core, float* utime)
+// Called every tick. Keep the frame in the ring, count down after a trigger or evaluate the rules. 
+void Flight_Recorder_Tick(void)
 {
-	FILE *fIn;
-	char szPath[512];
-	int nLen=SIZE_STAT, i=0, count=0;
-	int num_read;
-	char szBuff[SIZE_STAT+16];
-	char *pch, *str;
+	struct timeval tv_Now, tv_Diff;
+	double t;
+
+	if(fReplay)	{
+		t = tNow;
+	}
+	else	{
+		gettimeofday(&tv_Now, 0);
+		timersub(&tv_Now, &tv_Flight_Start, &tv_Diff);
+		t = tv_Diff.tv_sec + 0.000001*tv_Diff.tv_usec;
+	}
+	Flight_Len[iFlight_Head] = Serialize_Frame(Flight_Ring + (size_t)iFlight_Head*Flight_Slot_Size, t);
+	iFlight_Head = (iFlight_Head + 1) % nFlight_Slot;
+	if(nFlight_Frame < nFlight_Slot)	nFlight_Frame++;
+
+	if(nPost_Left > 0)	{	// collecting the frames after the trigger
+		nPost_Left--;
+		if(nPost_Left == 0)	{
+			Dump_Flight_Window();
+			nPost_Left = -1;
+		}
+		Evaluate_Triggers(NULL);	// keep the edge detection up to date
+		return;
+	}
+
+	if(Evaluate_Triggers(szFlight_Reason))	{
+		nPost_Left = Flight_Post;
+		if(nPost_Left == 0)	{
+			Dump_Flight_Window();
+			nPost_Left = -1;
+		}
+	}
+}
+
+// One pass over the cores. A rule fires when it becomes true, not while it stays true. 
+// Return 1 if any rule fired and describe it in szReason (if not NULL). 
+int Evaluate_Triggers(char szReason[])
+{
+	int i, s, bActive[3]={0, 0, 0}, bFired=0, nCore_Socket_Used[MAX_SOCKET], Core_Idle=-1, Core_Share=-1, Socket_Hot=-1;
+	float Socket_Usage[MAX_SOCKET];
+
+	memset(Socket_Usage, 0, sizeof(Socket_Usage));
+	memset(nCore_Socket_Used, 0, sizeof(nCore_Socket_Used));
+
+	for(i=0; i<nCore; i++)	{
+		if(bRule_Idle && bApp_Last[i] && (Core_Usage[i] < Idle_Threshold) && (Core_Idle < 0))	Core_Idle = i;
+		if(bRule_Share && (nApp_Core[i] >= Share_Threshold) && (Core_Share < 0))	Core_Share = i;
+		bApp_Last[i] = (nApp_Core[i] > 0) || (bApp_Last[i] && (Core_Usage[i] >= Idle_Threshold));	// sticky until the core goes idle. The scan may miss the last busy tick. 
+		s = SocketID[i];
+		if( (s >= 0) && (s < MAX_SOCKET) )	{
+			Socket_Usage[s] += Core_Usage[i];
+			nCore_Socket_Used[s]++;
+		}
+	}
+	if(bRule_Socket)	{
+		for(s=0; s<MAX_SOCKET; s++)	{
+			if( (nCore_Socket_Used[s] > 0) && (Socket_Usage[s] >= Socket_Threshold*nCore_Socket_Used[s]) )	{
+				Socket_Hot = s;
+				break;
+			}
+		}
+	}
+	bActive[0] = (Core_Idle >= 0);
+	bActive[1] = (Socket_Hot >= 0);
+	bActive[2] = (Core_Share >= 0);
+
+	if(szReason)	{
+		szReason[0] = 0;
+		if(bActive[0] && !bRule_Last[0])	{
+			sprintf(szReason+strlen(szReason), "core %d idle ", Core_Idle);
+			bFired = 1;
+		}
+		if(bActive[1] && !bRule_Last[1])	{
+			sprintf(szReason+strlen(szReason), "socket %d saturated ", Socket_Hot);
+			bFired = 1;
+		}
+		if(bActive[2] && !bRule_Last[2])	{
+			sprintf(szReason+strlen(szReason), "core %d shared by %d threads ", Core_Share, nApp_Core[Core_Share]);
+			bFired = 1;
+		}
+	}
+	if(bFired)	szReason[strlen(szReason)-1] = 0;	// the trailing space
+	for(i=0; i<3; i++)	bRule_Last[i] = bActive[i];
+	return bFired;
+}
+
+void Dump_Flight_Window(void)	// the frames in the ring, oldest first, as a record file. One writev() call. 
+{
+	char Header_Buf[MAX_HEADER_SIZE], szName[320];
+	struct iovec iov[MAX_FLIGHT_FRAME+1];
+	int i, idx, fd;
+	ssize_t nBytes=0, nWritten;
+
+	iov[0].iov_base = Header_Buf;
+	iov[0].iov_len = Serialize_Header(Header_Buf);
+	nBytes += iov[0].iov_len;
+	for(i=0; i<nFlight_Frame; i++)	{
+		idx = (iFlight_Head - nFlight_Frame + i + nFlight_Slot) % nFlight_Slot;
+		iov[i+1].iov_base = Flight_Ring + (size_t)idx*Flight_Slot_Size;
+		iov[i+1].iov_len = Flight_Len[idx];
+		nBytes += Flight_Len[idx];
+	}
+
+	snprintf(szName, sizeof(szName), "flight_%s_%d.rec", szHostName, nFlight_Dump);
+	fd = open(szName, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if(fd == -1)	{
+		snprintf(szFlight_Last, sizeof(szFlight_Last), "fail to open %s", szName);
+		return;
+	}
+	nWritten = writev(fd, iov, nFlight_Frame+1);
+	close(fd);
+	nFlight_Dump++;
+	if(nWritten != nBytes)	snprintf(szFlight_Last, sizeof(szFlight_Last), "%s is incomplete (%s)", szName, szFlight_Reason);
+	else	snprintf(szFlight_Last, sizeof(szFlight_Last), "%s (%s)", szName, szFlight_Reason);
+}
+
+void Open_Replay_File(char szName[])
+{
+	RECORD_HEADER Header;
+	size_t nRead=0;
+
+	fReplay = fopen(szName, "rb");
+	if(fReplay == NULL)	{
+		printf("Fail to open file: %s\nQuit\n", szName);
+		exit(1);
+	}
+	if( (fread(&Header, sizeof(RECORD_HEADER), 1, fReplay) != 1) || (strcmp(Header.szMagic, RECORD_MAGIC) != 0) )	{
+		printf("%s is not a core_usage record file.\nQuit\n", szName);
+		exit(1);
+	}
+	if( (Header.nCore <= 0) || (Header.nCore > MAX_CORE) )	{
+		printf("Invalid number of cores in %s: %d\nQuit\n", szName, Header.nCore);
+		exit(1);
+	}
+
+	nCore = Header.nCore;
+	nSocket = Header.nSocket;
+	nCore_Socket = Header.nCore_Socket;
+	nThread_per_Core = Header.nThread_per_Core;
+	Header.szHostName[63] = 0;
+	strcpy(szHostName, Header.szHostName);
+	tInterval = (Replay_Speed > 0.0) ? (Header.tInterval/Replay_Speed) : 0.0;
+	tNow = 0.0;
+
+	nRead += fread(SocketID, sizeof(int), nCore, fReplay);
+	nRead += fread(CoreID, sizeof(int), nCore, fReplay);
+	nRead += fread(ThreadID, sizeof(int), nCore, fReplay);
+	nRead += fread(NodeID, sizeof(int), nCore, fReplay);
+	nRead += fread(bCore_Shown, sizeof(int), nCore, fReplay);
+	if(nRead != (size_t)(5*nCore))	{
+		printf("%s is truncated in the topology.\nQuit\n", szName);
+		exit(1);
+	}
+	printf("Replaying %s recorded on node %s. There are %d cores.\n", szName, szHostName, nCore);
+
+	if(Read_Replay_Frame() == 0)	{
+		printf("No data in %s.\nQuit\n", szName);
+		exit(1);
+	}
+	Save_Core_Stat();
+	nFrame_Replayed = 0;
+}
+
+int Read_Replay_Frame(void)	// return 0 at the end of the record file
+{
+	RECORD_FRAME Frame;
+	RECORD_APP_CORE App_Core;
+	int i, nRead=0;
+
+	if(nFrame_Replayed == 0)	gettimeofday(&tv_Replay_Start, 0);	// start timing from the first frame rendered
+	if(fread(&Frame, sizeof(RECORD_FRAME), 1, fReplay) != 1)	return 0;
+
+	nRead += fread(cur_user, sizeof(unsigned long long), nCore, fReplay);
+	nRead += fread(cur_nice, sizeof(unsigned long long), nCore, fReplay);
+	nRead += fread(cur_system, sizeof(unsigned long long), nCore, fReplay);
+	nRead += fread(cur_idle, sizeof(unsigned long long), nCore, fReplay);
+	nRead += fread(cur_iowait, sizeof(unsigned long long), nCore, fReplay);
+	nRead += fread(cur_irq, sizeof(unsigned long long), nCore, fReplay);
+	nRead += fread(cur_softirq, sizeof(unsigned long long), nCore, fReplay);
+	nRead += fread(cur_steal, sizeof(unsigned long long), nCore, fReplay);
+	if(nRead != 8*nCore)	return 0;	// truncated frame
+
+	memset(nApp_Core, 0, sizeof(int)*MAX_CORE);
+	memset(Core_Wait, 0, sizeof(float)*MAX_CORE);
+	memset(Core_Wait_Latency, 0, sizeof(float)*MAX_CORE);
+	for(i=0; i<Frame.nCore_App; i++)	{
+		if(fread(&App_Core, sizeof(RECORD_APP_CORE), 1, fReplay) != 1)	return 0;
+		if( (App_Core.core < 0) || (App_Core.core >= nCore) || (App_Core.nApp <= 0) )	return 0;
+		nApp_Core[App_Core.core] = App_Core.nApp;
+		Core_Wait[App_Core.core] = App_Core.Wait;
+		Core_Wait_Latency[App_Core.core] = App_Core.Wait_Latency;
+		if(fread(szAppList[App_Core.core], MAX_APP_NAME_LEN, (App_Core.nApp < MAX_APP) ? App_Core.nApp : MAX_APP, fReplay) != (size_t)((App_Core.nApp < MAX_APP) ? App_Core.nApp : MAX_APP))	return 0;
+	}
+
+	Migration_Rate = Frame.Migration_Rate;
+	Total_Wait = Frame.Total_Wait;
+	Max_Wait = Frame.Max_Wait;
+	Core_Max_Wait = Frame.Core_Max_Wait;
+	Avg_Wait_Latency = Frame.Avg_Wait_Latency;
+	tNow = Frame.t;
+	nFrame_Replayed++;
+
+	return 1;
+}
+
+void Finish_Replay(void)	// report the replay rate. Useful to benchmark rendering and parsing. 
+{
+	struct timeval tv_Now, tv_Diff;
+	double dt;
+
+	gettimeofday(&tv_Now, 0);
+	timersub(&tv_Now, &tv_Replay_Start, &tv_Diff);
+	dt = tv_Diff.tv_sec + 0.000001*tv_Diff.tv_usec;
+
+#ifndef NO_NCURSES
+	if(mainwin)	{
+		delwin(mainwin);
+		endwin();
+	}
+#endif
+	printf("Replayed %d frames in %.3lf s (%.1lf frames/s).\n", nFrame_Replayed, dt, (dt > 0.0) ? (nFrame_Replayed/dt) : 0.0);
+	Print_Summary(stdout);
+	exit(0);
+}
+
+void Start_Sampler(void)
+{
+	unsigned int nPer_Frame;
+	int ret;
+	sigset_t Sig_Set, Old_Set;
+
+	nPer_Frame = (unsigned int)(tInterval/tSample) + 1;	// samples taken between two frames, rounded up
+	while( (nSample_Ring < 2*nPer_Frame) && (nSample_Ring < MAX_SAMPLE_RING) )	nSample_Ring *= 2;	// margin for slow frames
+	if(nSample_Ring < nPer_Frame)	printf("Warning: %u samples per frame do not fit in the ring of %d. Samples will be dropped.\n", nPer_Frame, nSample_Ring);
+	Sample_Ring = (float*)malloc(sizeof(float)*nSample_Ring*(nCore+1));
+	if(Sample_Ring == NULL)	{
+		printf("Fail to allocate memory for the sample ring.\nQuit\n");
+		exit(1);
+	}
+	sigemptyset(&Sig_Set);	// signals go to the main thread, so they interrupt its sleep
+	sigaddset(&Sig_Set, SIGINT);
+	sigaddset(&Sig_Set, SIGTERM);
+	sigaddset(&Sig_Set, SIGUSR1);
+	pthread_sigmask(SIG_BLOCK, &Sig_Set, &Old_Set);	// inherited by the sampler
+	ret = pthread_create(&Sampler_Thread_ID, NULL, Sampler_Main, NULL);
+	pthread_sigmask(SIG_SETMASK, &Old_Set, NULL);
+	if(ret != 0)	{
+		printf("Fail to create the sampler thread. Sampling at display rate.\n");
+		bSampler = 0;
+		return;
+	}
+	printf("Sampling per-core counters every %.3f s.\n", tSample);
+}
+
+void *Sampler_Main(void *arg __attribute__((unused)))	// read /proc/stat every tSample and push per-core usage into the ring
+{
+	int fd=-1, i, num_read, nCore_Read;
+	unsigned int head, tail;
+	char *szBuf;
+	unsigned long long *Busy, *Total, *Old_Busy, *Old_Total, dTotal, ns_Used;
+	struct timespec ts_Next, ts_Now, ts_CPU_0, ts_CPU_1, ts_Read, ts_Last;
+	long long period_ns = (long long)(tSample*1.0E9);
+	float *pSlot;
+
+	__atomic_store_n(&Sampler_Tid, (int)syscall(SYS_gettid), __ATOMIC_RELAXED);	// not my app. Skipped in cgroup mode. 
+	szBuf = (char*)malloc(PROC_STAT_BUF_SIZE);
+	Busy = (unsigned long long*)malloc(sizeof(unsigned long long)*MAX_CORE*4);
+	if( (szBuf == NULL) || (Busy == NULL) )	goto Fail;
+	Total = Busy + MAX_CORE;
+	Old_Busy = Total + MAX_CORE;
+	Old_Total = Old_Busy + MAX_CORE;
+
+	fd = open("/proc/stat", O_RDONLY, 0);	// keep it open. pread() at offset 0 regenerates the content. 
+	if(fd == -1)	goto Fail;
+
+	num_read = pread(fd, szBuf, PROC_STAT_BUF_SIZE-1, 0);
+	if(num_read <= 0)	goto Fail;
+	szBuf[num_read] = 0;
+	Parse_Proc_Stat_Buf(szBuf, Old_Busy, Old_Total);
+	clock_gettime(CLOCK_MONOTONIC, &ts_Last);
+	__atomic_store_n(&bSampler_Running, 1, __ATOMIC_RELEASE);
+
+	clock_gettime(CLOCK_MONOTONIC, &ts_Next);
+	while(1)	{
+		ts_Next.tv_nsec += period_ns;	// absolute deadlines, so the period does not drift
+		while(ts_Next.tv_nsec >= 1000000000)	{
+			ts_Next.tv_nsec -= 1000000000;
+			ts_Next.tv_sec++;
+		}
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts_Next, NULL);
+		clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts_CPU_0);
+
+		num_read = pread(fd, szBuf, PROC_STAT_BUF_SIZE-1, 0);
+		if(num_read <= 0)	continue;
+		clock_gettime(CLOCK_MONOTONIC, &ts_Read);
+		szBuf[num_read] = 0;
+		nCore_Read = Parse_Proc_Stat_Buf(szBuf, Busy, Total);
+		if(nCore_Read > nCore)	nCore_Read = nCore;
+
+		head = Ring_Head;
+		tail = __atomic_load_n(&Ring_Tail, __ATOMIC_ACQUIRE);
+		if( (head - tail) >= nSample_Ring )	{	// the renderer is behind. Drop this sample. The next one covers its time. 
+			__atomic_store_n(&nSample_Dropped, nSample_Dropped+1, __ATOMIC_RELAXED);
+		}
+		else	{
+			pSlot = Sample_Ring + (head & (nSample_Ring-1))*(nCore+1);
+			for(i=0; i<nCore_Read; i++)	{
+				dTotal = Total[i] - Old_Total[i];
+				pSlot[i] = (dTotal > 0) ? (1.0*(Busy[i] - Old_Busy[i])/dTotal) : 0.0;
+			}
+			for(; i<nCore; i++)	{
+				pSlot[i] = 0.0;
+			}
+			pSlot[nCore] = (ts_Read.tv_sec - ts_Last.tv_sec) + 1.0E-9*(ts_Read.tv_nsec - ts_Last.tv_nsec);	// longer than tSample after an overrun
+			__atomic_store_n(&Ring_Head, head+1, __ATOMIC_RELEASE);
+			memcpy(Old_Busy, Busy, sizeof(unsigned long long)*nCore_Read);
+			memcpy(Old_Total, Total, sizeof(unsigned long long)*nCore_Read);
+			ts_Last = ts_Read;
+		}
+
+		clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts_CPU_1);
+		ns_Used = (ts_CPU_1.tv_sec - ts_CPU_0.tv_sec)*1000000000LL + (ts_CPU_1.tv_nsec - ts_CPU_0.tv_nsec);
+		__atomic_store_n(&Sampler_ns, Sampler_ns + ns_Used, __ATOMIC_RELAXED);
+		__atomic_store_n(&nSample_Taken, nSample_Taken+1, __ATOMIC_RELAXED);
+
+		clock_gettime(CLOCK_MONOTONIC, &ts_Now);
+		if( (ts_Now.tv_sec > ts_Next.tv_sec) || ( (ts_Now.tv_sec == ts_Next.tv_sec) && (ts_Now.tv_nsec > ts_Next.tv_nsec) ) )	{
+			ts_Next = ts_Now;	// overrun. Do not try to catch up. 
+		}
+	}
+	return NULL;
+
+Fail:	// the renderer keeps updating the statistics once per frame
+	if(fd != -1)	close(fd);
+	if(szBuf)	free(szBuf);
+	if(Busy)	free(Busy);
+	return NULL;
+}
+
+int Parse_Proc_Stat_Buf(char *szBuf, unsigned long long Busy[], unsigned long long Total[])	// return the number of cores parsed
+{
+	char *p=szBuf;
+	unsigned long long Value[8];
+	int i, n=0;
+
+	p = strchr(p, '\n');	// skip the line of the total
+	while(p)	{
+		p++;
+		if( (p[0] != 'c') || (p[1] != 'p') || (p[2] != 'u') || (p[3] < '0') || (p[3] > '9') )	break;	// the end of cpu lines
+		p += 3;
+		strtoul(p, &p, 10);	// cpu index
+		for(i=0; i<8; i++)	{	// user nice system idle iowait irq softirq steal
+			Value[i] = strtoull(p, &p, 10);
+		}
+		Busy[n] = Value[0] + Value[1] + Value[2] + Value[5] + Value[6] + Value[7];
+		Total[n] = Busy[n] + Value[3] + Value[4];
+		n++;
+		if(n >= MAX_CORE)	break;
+		p = strchr(p, '\n');
+	}
+	return n;
+}
+
+void Drain_Sample_Ring(void)	// peak and min of the samples since last frame. Only called by the renderer. 
+{
+	unsigned int head, tail, nSample, k;
+	int i;
+	float *pSlot;
+	unsigned long long ns_Now, nTaken_Now;
+	static unsigned long long ns_Last=0, nTaken_Last=0;
+	static struct timeval tv_Last={0, 0};
+	struct timeval tv_Now, tv_Diff;
+	double dt;
+
+	tail = Ring_Tail;
+	head = __atomic_load_n(&Ring_Head, __ATOMIC_ACQUIRE);
+	nSample = head - tail;
+
+	for(i=0; i<nCore; i++)	{
+		Core_Usage_Min[i] = 1.0E9;
+		Core_Usage_Max[i] = -1.0;
+	}
+	for(k=tail; k!=head; k++)	{
+		pSlot = Sample_Ring + (k & (nSample_Ring-1))*(nCore+1);
+		for(i=0; i<nCore; i++)	{
+			if(pSlot[i] < Core_Usage_Min[i])	Core_Usage_Min[i] = pSlot[i];
+			if(pSlot[i] > Core_Usage_Max[i])	Core_Usage_Max[i] = pSlot[i];
+		}
+		Update_Core_Stats(pSlot, pSlot[nCore]);
+	}
+	__atomic_store_n(&Ring_Tail, head, __ATOMIC_RELEASE);
+
+	if(nSample == 0)	{	// no sample yet
+		for(i=0; i<nCore; i++)	{
+			Core_Usage_Min[i] = Core_Usage_Max[i] = Core_Usage[i];
+		}
+	}
+
+	ns_Now = __atomic_load_n(&Sampler_ns, __ATOMIC_RELAXED);
+	nTaken_Now = __atomic_load_n(&nSample_Taken, __ATOMIC_RELAXED);
+	gettimeofday(&tv_Now, 0);
+	if(tv_Last.tv_sec > 0)	{
+		timersub(&tv_Now, &tv_Last, &tv_Diff);
+		dt = tv_Diff.tv_sec + 0.000001*tv_Diff.tv_usec;
+		if(dt > 0.0)	{
+			Sample_Rate = (nTaken_Now - nTaken_Last)/dt;
+			Sampler_Load = 1.0E-9*(ns_Now - ns_Last)/dt;
+		}
+		Sampler_us_per_Sample = (nTaken_Now > nTaken_Last) ? (0.001*(ns_Now - ns_Last)/(nTaken_Now - nTaken_Last)) : 0.0;
+	}
+	ns_Last = ns_Now;
+	nTaken_Last = nTaken_Now;
+	tv_Last = tv_Now;
+}
+
+void Update_Core_Stats(float Usage[], double dt)	// add one sample of all cores to the histograms and idle-run counters
+{
+	int i, iBin;
+	float u;
+
+	for(i=0; i<nCore; i++)	{
+		u = Usage[i];
+		if(u < 0.0)	u = 0.0;
+		if(u > 1.0)	u = 1.0;
+		iBin = (int)(u*USAGE_BINS);
+		Usage_Hist[i][iBin]++;
+		Sum_Usage[i] += u;
+		if(u < IDLE_THRESHOLD)	{
+			Idle_Time[i] += dt;
+			Idle_Run[i] += dt;
+			if(Idle_Run[i] > Idle_Run_Max[i])	Idle_Run_Max[i] = Idle_Run[i];
+		}
+		else	{
+			Idle_Run[i] = 0.0;
+		}
+	}
+	Stat_Time += dt;
+	nStat_Sample++;
+}
+
+float Usage_Percentile(int core, float p)	// the middle of the bin holding the p-th sample
+{
+	unsigned long long nTarget, nSum=0;
+	int iBin;
+
+	nTarget = (unsigned long long)(p*nStat_Sample);
+	if(nTarget >= nStat_Sample)	nTarget = nStat_Sample - 1;
+	for(iBin=0; iBin<USAGE_BINS; iBin++)	{
+		nSum += Usage_Hist[core][iBin];
+		if(nSum > nTarget)	break;
+	}
+	if(iBin == USAGE_BINS)	return 1.0;
+	return (iBin + 0.5)/USAGE_BINS;
+}
+
+void Print_Summary(FILE *fOut)	// per-core usage percentiles and idle statistics since start
+{
+	int i, k;
+	double Sum_p50=0.0, Sum_Mean=0.0, Sum_Idle=0.0, Max_Run=0.0;
+
+	if(nStat_Sample == 0)	return;
+	fprintf(fOut, "Summary of %llu samples over %.1f s on node %s. Idle means usage below %.0f%%.\n", nStat_Sample, Stat_Time, szHostName, 100.0*IDLE_THRESHOLD);
+	fprintf(fOut, " core   mean   p50   p95   p99  idle%%  max_idle(s)\n");
+	for(k=0; k<nCore_Shown; k++)	{
+		i = Core_Shown_List[k];
+		fprintf(fOut, "%5d  %5.2f  %4.2f  %4.2f  %4.2f  %5.1f  %11.1f\n", i, Sum_Usage[i]/nStat_Sample, Usage_Percentile(i, 0.5), Usage_Percentile(i, 0.95), Usage_Percentile(i, 0.99), 
+			(Stat_Time > 0.0) ? (100.0*Idle_Time[i]/Stat_Time) : 0.0, Idle_Run_Max[i]);
+		Sum_p50 += Usage_Percentile(i, 0.5);
+		Sum_Mean += Sum_Usage[i]/nStat_Sample;
+		Sum_Idle += (Stat_Time > 0.0) ? (100.0*Idle_Time[i]/Stat_Time) : 0.0;
+		if(Idle_Run_Max[i] > Max_Run)	Max_Run = Idle_Run_Max[i];
+	}
+	if(nCore_Shown > 0)	fprintf(fOut, "  avg  %5.2f  %4.2f              %5.1f  %11.1f (max)\n", Sum_Mean/nCore_Shown, Sum_p50/nCore_Shown, Sum_Idle/nCore_Shown, Max_Run);
+}
+
+void Write_Summary_File(void)	// on SIGUSR1. The screen belongs to the front end, so it goes to a file. 
+{
+	char szName[320];
+	FILE *fOut;
+
+	snprintf(szName, sizeof(szName), "summary_core_usage_%s.txt", szHostName);
+	fOut = fopen(szName, "w");
+	if(fOut == NULL)	return;
+	Print_Summary(fOut);
+	fclose(fOut);
+}
+
+static void Request_Summary(int sig __attribute__((unused)))
+{
+	bSummary_Requested = 1;
+}
+
+void Init_Interrupt_Stat(void)
+{
+	fd_Interrupts = open("/proc/interrupts", O_RDONLY, 0);
+	fd_Softirqs = open("/proc/softirqs", O_RDONLY, 0);
+	if( (fd_Interrupts == -1) && (fd_Softirqs == -1) )	{
+		printf("Fail to open /proc/interrupts and /proc/softirqs. The interrupt view is disabled.\n");
+		bIRQ = 0;
+		return;
+	}
+	IRQ_Buf_Size = 64*1024;
+	szIRQ_Buf = (char*)malloc(IRQ_Buf_Size);
+	if(szIRQ_Buf == NULL)	{
+		bIRQ = 0;
+		return;
+	}
+	Sample_Interrupts();	// the baseline
+}
+
+void Sample_Interrupts(void)	// per-core interrupt rates by source since last sample
+{
+	int i, j, Top;
+	struct timeval tv_Now, tv_Diff;
+	static struct timeval tv_Last={0, 0};
+	double dt=0.0;
+
+	memset(IRQ_Count, 0, sizeof(unsigned long long)*N_IRQ_CLASS*MAX_CORE);
+	if(Read_Whole_File(fd_Interrupts))	Parse_Interrupt_Table(0);
+	if(Read_Whole_File(fd_Softirqs))	Parse_Interrupt_Table(1);
+
+	gettimeofday(&tv_Now, 0);
+	if(tv_Last.tv_sec > 0)	{
+		timersub(&tv_Now, &tv_Last, &tv_Diff);
+		dt = tv_Diff.tv_sec + 0.000001*tv_Diff.tv_usec;
+	}
+	tv_Last = tv_Now;
+
+	nIRQ_Hot = 0;
+	for(i=0; i<nCore; i++)	{
+		IRQ_Rate_Total[i] = 0.0;
+		Top = 0;
+		for(j=0; j<N_IRQ_CLASS; j++)	{
+			IRQ_Rate[j][i] = ( (dt > 0.0) && (IRQ_Count[j][i] >= IRQ_Count_Old[j][i]) ) ? ((IRQ_Count[j][i] - IRQ_Count_Old[j][i])/dt) : 0.0;
+			IRQ_Rate_Total[i] += IRQ_Rate[j][i];
+			if(IRQ_Rate[j][i] > IRQ_Rate[Top][i])	Top = j;
+		}
+		IRQ_Top_Class[i] = Top;
+		bIRQ_Hot[i] = (nApp_Core[i] > 0) && ( (IRQ_Rate[IRQ_NET][i] + IRQ_Rate[IRQ_BLK][i]) >= IRQ_HOT_THRESHOLD );
+		nIRQ_Hot += bIRQ_Hot[i];
+	}
+	memcpy(IRQ_Count_Old, IRQ_Count, sizeof(unsigned long long)*N_IRQ_CLASS*MAX_CORE);
+}
+
+int Read_Whole_File(int fd)	// read the file into szIRQ_Buf from the beginning. Grow the buffer if needed. 
+{
+	int num_read, nRead=0;
+	char *p;
+
+	if(fd == -1)	return 0;
+	while(1)	{
+		num_read = pread(fd, szIRQ_Buf + nRead, IRQ_Buf_Size - 1 - nRead, nRead);
+		if(num_read <= 0)	break;
+		nRead += num_read;
+		if(nRead == (IRQ_Buf_Size - 1))	{	// may have more
+			p = (char*)realloc(szIRQ_Buf, IRQ_Buf_Size*2);
+			if(p == NULL)	break;
+			szIRQ_Buf = p;
+			IRQ_Buf_Size *= 2;
+		}
+	}
+	szIRQ_Buf[nRead] = 0;
+	return (nRead > 0);
+}
+
+// Column oriented parser of /proc/interrupts and /proc/softirqs. The header gives the cpu of each column. 
+// Each row is a label, one counter per column and an optional description. 
+void Parse_Interrupt_Table(int bSoftirq)
+{
+	char *p=szIRQ_Buf, *p_Label, *p_Desc, *p_End, szLabel[32], szDesc[256];
+	int nCol=0, Col_CPU[MAX_CORE], col, n, IRQ_Class;
+	unsigned long long Value, Row_Count[MAX_CORE];
+
+	while( (*p != '\n') && (*p != 0) )	{	// header like "    CPU0  CPU1  CPU2"
+		while(*p == ' ')	p++;
+		if(strncmp(p, "CPU", 3) == 0)	{
+			if(nCol < MAX_CORE)	Col_CPU[nCol++] = atoi(p+3);
+			p += 3;
+		}
+		while( (*p != ' ') && (*p != '\n') && (*p != 0) )	p++;
+	}
+	if(*p == '\n')	p++;
+
+	while(*p)	{
+		while(*p == ' ')	p++;
+		p_Label = p;
+		while( (*p != ':') && (*p != '\n') && (*p != 0) )	p++;
+		if(*p != ':')	{	// not a valid row
+			if(*p == '\n')	p++;
+			continue;
+		}
+		n = p - p_Label;
+		if(n > 31)	n = 31;
+		memcpy(szLabel, p_Label, n);
+		szLabel[n] = 0;
+		p++;
+
+		for(col=0; col<nCol; col++)	{	// the counters. Only spaces between them. 
+			while(*p == ' ')	p++;
+			if( (*p < '0') || (*p > '9') )	break;
+			Value = 0;
+			while( (*p >= '0') && (*p <= '9') )	{
+				Value = Value*10 + (*p - '0');
+				p++;
+			}
+			Row_Count[col] = Value;
+		}
+
+		while(*p == ' ')	p++;
+		p_Desc = p;
+		while( (*p != '\n') && (*p != 0) )	p++;
+		p_End = p;
+		if(*p == '\n')	p++;
+
+		if(col < nCol)	continue;	// rows like ERR and MIS have only one counter
+		n = p_End - p_Desc;
+		if(n > 255)	n = 255;
+		memcpy(szDesc, p_Desc, n);
+		szDesc[n] = 0;
+
+		IRQ_Class = Classify_Interrupt(szLabel, szDesc, bSoftirq);
+		for(col=0; col<nCol; col++)	{
+			if(Col_CPU[col] < nCore)	IRQ_Count[IRQ_Class][Col_CPU[col]] += Row_Count[col];
+		}
+	}
+}
+
+int Classify_Interrupt(char szLabel[], char szDesc[], int bSoftirq)
+{
+	const char *szNet[]={"-input", "-output", "-rx", "-tx", "TxRx", "eth", "mlx", "hfi", "bnxt", "i40e", "ice-", "ixgbe", "igb", "efa", NULL};
+	const char *szBlk[]={"nvme", "-req", "ahci", "ata", "scsi", "megasas", "mpt", NULL};
+	int i;
+
+	if(bSoftirq)	{
+		if( (strcmp(szLabel, "NET_RX") == 0) || (strcmp(szLabel, "NET_TX") == 0) )	return IRQ_NET;
+		if( (strcmp(szLabel, "BLOCK") == 0) || (strcmp(szLabel, "IRQ_POLL") == 0) )	return IRQ_BLK;
+		if( (strcmp(szLabel, "TIMER") == 0) || (strcmp(szLabel, "HRTIMER") == 0) )	return IRQ_TMR;
+		return IRQ_OTH;
+	}
+
+	if( (szLabel[0] >= '0') && (szLabel[0] <= '9') )	{	// device interrupts
+		for(i=0; szNet[i]; i++)	{
+			if(strstr(szDesc, szNet[i]))	return IRQ_NET;
+		}
+		for(i=0; szBlk[i]; i++)	{
+			if(strstr(szDesc, szBlk[i]))	return IRQ_BLK;
+		}
+		return IRQ_OTH;
+	}
+	if( (strcmp(szLabel, "LOC") == 0) || (strcmp(szLabel, "HRT") == 0) )	return IRQ_TMR;
+	if( (strcmp(szLabel, "RES") == 0) || (strcmp(szLabel, "CAL") == 0) || (strcmp(szLabel, "TLB") == 0) || (strncmp(szLabel, "IPI", 3) == 0) )	return IRQ_IPI;
+	return IRQ_OTH;
+}
+
+static void Clean_up(int sig __attribute__((unused)), siginfo_t *siginfo __attribute__((unused)), void *ptr __attribute__((unused)))
+{
+	bQuit_Requested = 1;	// stdio and curses are not async-signal-safe. The main loop finishes the job. 
+}
+
+void Quit_With_Summary(void)	// restore the terminal, print the summary table and exit
+{
+	//	usleep(1500000);
+#ifndef NO_NCURSES
+	if(mainwin)	{
+	    delwin(mainwin);
+	    endwin();
+	    refresh();
+	}
+#endif
+	if(__atomic_load_n(&bSampler_Running, __ATOMIC_ACQUIRE))	Drain_Sample_Ring();	// the samples since last frame
+	Print_Summary(stdout);
+	
+	exit(0);
+}
+
+int Get_Logic_Core_ID(int Phys_Cores_on_Socket[], int Phys_Core_ID, int& Thread)
+{
+	int i=0, Logic_ID=-1;
+
+	Thread=-1;
+
+	while(Phys_Cores_on_Socket[i] != (-1) )	{
+		if(Phys_Cores_on_Socket[i] == Phys_Core_ID)	{
+			Thread++;
+			if( Logic_ID == (-1) )	{	// set logic core id
+				Logic_ID = i;
+			}
+		}
+		i++;
+		if(i>=MAX_CORE)	{
+			printf("i>=MAX_CORE in Get_Logic_Core_ID(). Must be something wrong.\n");
+			break;
+		}
+	}
+	
+	if( Thread == (-1) )	Logic_ID = i;	// the count of logic cores
+	Phys_Cores_on_Socket[i] = Phys_Core_ID;	// insert the new physical core id
+	Thread++;	// the first thread
+
+	return Logic_ID;
+}
+
+void Enumerate_All_PID(void)	// exhaustively enumerate all PIDs
+{
+	DIR *dp, *dp_task;
+	struct dirent *ep, *ep_task;
+	char szPath[512], c;
+	struct stat file_stat;
+	int pid, tid;
+	struct timeval tv_Now, tv_Diff;
+	double dt;
+	unsigned long long Sum_Wait_ns=0, Sum_nSlice=0, nPeriod, nThrottled, Throttled_ns;
+	int i, bThrottle_Valid=0;
+
+	memset(nApp_Core, 0, sizeof(int)*MAX_CORE);
+	memset(Core_Wait_ns, 0, sizeof(unsigned long long)*MAX_CORE);
+	memset(Core_nSlice, 0, sizeof(unsigned long long)*MAX_CORE);
+
+	idx_Tab_Cur ^= 1;	// the table filled in last scan becomes the old one
+	memset(Thread_Core_Tab[idx_Tab_Cur], 0, sizeof(THREAD_CORE_REC)*MAX_TRACKED_THREAD);
+	bTab_Full[idx_Tab_Cur] = 0;
+	nMigration = 0;
+
+	for(i=0; i<nApp_Used; i++)	memset(&(App_Tab[App_Used[i]]), 0, sizeof(APP_REC));
+	for(i=0; i<nProc_Used; i++)	memset(&(Proc_Tab[Proc_Used[i]]), 0, sizeof(APP_REC));
+	nApp_Used = nProc_Used = 0;
+	memset(&App_Other, 0, sizeof(APP_REC));
+	memset(&Proc_Other, 0, sizeof(APP_REC));
+	strcpy(App_Other.szName, "(other)");
+	strcpy(Proc_Other.szName, "(other)");
+
+//	printf("pid     Exe_Name             tid     Affinity\n", pid, szExeName);
+	
+	if(bCgroup)	{	// only the tasks in the cgroup. No need to walk /proc. 
+		if(bUring)	Read_Self_Tids();	// io_uring workers come and go
+		Enumerate_Cgroup_Tasks(szCgroup_Dir);
+		bThrottle_Valid = Read_Cgroup_CPU_Stat(&nPeriod, &nThrottled, &Throttled_ns);
+		dp = NULL;
+	}
+	else	{
+		dp = opendir("/proc");
+		if(dp == NULL)	perror ("Couldn't open the directory");
+	}
+	if (dp != NULL)	{
+		while (ep = readdir (dp))	{
+			sprintf(szPath, "/proc/%s", ep->d_name);
+			c = ep->d_name[0];
+			if( (c < '0') || (c > '9') )	continue;	// not starting with a number
+			
+			pid = atoi(ep->d_name);
+			
+			if(stat(szPath, &file_stat) == -1)	continue;	// error
+			if(pid == my_pid)	continue;	// skip checking my tools itself
+			
+			if(file_stat.st_uid == my_uid)	{	// build the list of my jobs
+				sprintf(szPath, "/proc/%d/task", pid);
+				dp_task = opendir(szPath);
+				if (dp_task != NULL)	{
+					while( ep_task = readdir (dp_task) )	{
+						c = ep_task->d_name[0];
+						if( (c < '0') || (c > '9') )	continue;	// not starting with a number
+						
+						tid = atoi(ep_task->d_name);
+						Check_Thread(pid, tid);
+					}
+					closedir(dp_task);
+				}
+				else
+					perror ("Couldn't open the directory");
+			}
+		}
+		closedir(dp);
+	}
+	if(nUring_Batch > 0)	Flush_Uring_Batch();	// the rest in queue
+	
+//	printf("nJob = %d  nMyJob = %d\n", nJobs, nMyJob);
+
+	gettimeofday(&tv_Now, 0);
+	if(bTab_Old_Valid)	{
+		timersub(&tv_Now, &tv_Last_Scan, &tv_Diff);
+		dt = tv_Diff.tv_sec + 0.000001*tv_Diff.tv_usec;
+		Migration_Rate = (dt > 0.0) ? (nMigration/dt) : 0.0;
+
+		Total_Wait = Max_Wait = 0.0;
+		Core_Max_Wait = 0;
+		for(i=0; i<nCore; i++)	{
+			Core_Wait[i] = (dt > 0.0) ? (1.0E-9*Core_Wait_ns[i]/dt) : 0.0;
+			Core_Wait_Latency[i] = (Core_nSlice[i] > 0) ? (0.001*Core_Wait_ns[i]/Core_nSlice[i]) : 0.0;
+			Total_Wait += Core_Wait[i];
+			if(Core_Wait[i] > Max_Wait)	{
+				Max_Wait = Core_Wait[i];
+				Core_Max_Wait = i;
+			}
+			Sum_Wait_ns += Core_Wait_ns[i];
+			Sum_nSlice += Core_nSlice[i];
+		}
+		Avg_Wait_Latency = (Sum_nSlice > 0) ? (0.001*Sum_Wait_ns/Sum_nSlice) : 0.0;
+		Rank_Apps(dt);
+
+		if(bThrottle_Valid && (nPeriod >= Cgroup_nPeriod) && (nThrottled >= Cgroup_nThrottled) && (Throttled_ns >= Cgroup_Throttled_ns))	{
+			Total_Periods = nPeriod - Cgroup_nPeriod;
+			Throttled_Periods = nThrottled - Cgroup_nThrottled;
+			Throttle_Time = (dt > 0.0) ? (1.0E-9*(Throttled_ns - Cgroup_Throttled_ns)/dt) : 0.0;
+		}
+	}
+	if(bThrottle_Valid)	{
+		Cgroup_nPeriod = nPeriod;
+		Cgroup_nThrottled = nThrottled;
+		Cgroup_Throttled_ns = Throttled_ns;
+	}
+	tv_Last_Scan = tv_Now;
+	bTab_Old_Valid = 1;
+}
+
+void Check_Thread(int pid, int tid)	// attribute tid to its core if it is running and busy. Account its CPU time to its app. 
+{
+	char szExeName[512];
+	int core, IsRunning, bBusy;
+	float utime;
+	unsigned long long run_ns=0, wait_ns=0, nSlice=0, cpu_ticks;
+
+	if( (tid == my_pid) || Is_Self_Tid(tid) )	return;	// skip checking my tools itself
+	nThread_Scanned++;
+
+	if(bUring)	{	// queue it. The files are read in batches. 
+		Uring_Batch_Pid[nUring_Batch] = pid;
+		Uring_Batch_Tid[nUring_Batch++] = tid;
+		if(nUring_Batch == URING_BATCH)	Flush_Uring_Batch();
+		return;
+	}
+
+	IsRunning = Extract_Exec_Name(tid, szExeName, &core, &utime, &cpu_ticks);
+	if(IsRunning < 0)	return;	// the thread is gone
+
+	bBusy = IsRunning && (utime > 1.0);	// larger than 1 s. 
+	if(bBusy)	{
+		if(Read_Sched_Stat(tid, &run_ns, &wait_ns, &nSlice) == 0)	{
+			run_ns = wait_ns = nSlice = 0;	// schedstat is not available
+		}
+	}
+	Account_Thread(pid, tid, szExeName, core, bBusy, cpu_ticks, run_ns, wait_ns, nSlice);
+}
+
+void Read_Self_Tids(void)	// the io_uring workers (iou-wrk-*) are threads of my process
+{
+	DIR *dp;
+	struct dirent *ep;
+
+	nSelf_Tid = 0;
+	dp = opendir("/proc/self/task");
+	if(dp == NULL)	return;
+	while( (ep = readdir(dp)) && (nSelf_Tid < MAX_SELF_TID) )	{
+		if( (ep->d_name[0] < '0') || (ep->d_name[0] > '9') )	continue;
+		Self_Tid[nSelf_Tid++] = atoi(ep->d_name);
+	}
+	closedir(dp);
+}
+
+int Is_Self_Tid(int tid)
+{
+	int i;
+
+	if(tid == __atomic_load_n(&Sampler_Tid, __ATOMIC_RELAXED))	return 1;
+	for(i=0; i<nSelf_Tid; i++)	{
+		if(Self_Tid[i] == tid)	return 1;
+	}
+	return 0;
+}
+
+void Account_Thread(int pid, int tid, char szExeName[], int core, int bBusy, unsigned long long cpu_ticks, unsigned long long run_ns, unsigned long long wait_ns, unsigned long long nSlice)
+{
+	unsigned long long Ticks;
+
+	if( (core < 0) || (core >= MAX_CORE) )	return;
+	if(bBusy)	{
+		if(nApp_Core[core] < MAX_APP)	strncpy(szAppList[core][nApp_Core[core]], szExeName, MAX_APP_NAME_LEN);
+		nApp_Core[core]++;	// keep counting beyond MAX_APP for oversubscription detection
+	}
+	Ticks = Track_Thread(tid, &pid, core, bBusy, cpu_ticks, run_ns, wait_ns, nSlice);
+	if( (Ticks > 0) || bBusy )	Add_App_CPU(pid, tid, szExeName, core, bBusy, Ticks);
+}
+
+// Record the core, CPU time and schedstat counters of tid. Compare with last scan to count migrations and 
+// accumulate the run-queue wait time of this interval on the core. Return the CPU ticks used since last scan. 
+// *pid is 0 for the task list of a cgroup. It is taken from last scan, or looked up once for a new thread that used CPU. 
+unsigned long long Track_Thread(int tid, int *pid, int core, int bBusy, unsigned long long cpu_ticks, unsigned long long run_ns, unsigned long long wait_ns, unsigned long long nSlice)
+{
+	int idx, idx_Hash;
+	unsigned long long Ticks;
+	THREAD_CORE_REC *pTab=Thread_Core_Tab[idx_Tab_Cur], *pTab_Old=Thread_Core_Tab[1-idx_Tab_Cur], *pRec;
+
+	idx = idx_Hash = (tid * 2654435761U) & (MAX_TRACKED_THREAD-1);	// multiplicative hashing with linear probing
+
+	while( (pTab[idx].tid != 0) && (pTab[idx].tid != tid) )	{
+		idx = (idx+1) & (MAX_TRACKED_THREAD-1);
+		if(idx == idx_Hash)	{	// table is full. 
+			bTab_Full[idx_Tab_Cur] = 1;
+			return 0;
+		}
+	}
+	pRec = &(pTab[idx]);
+	pRec->tid = tid;
+	pRec->tgid = *pid;
+	pRec->core = core;
+	pRec->bBusy = bBusy;
+	pRec->cpu_ticks = cpu_ticks;
+	pRec->run_ns = run_ns;
+	pRec->wait_ns = wait_ns;
+	pRec->nSlice = nSlice;
+
+	Ticks = 0;
+	if(bTab_Old_Valid)	{
+		Ticks = bTab_Full[1-idx_Tab_Cur] ? 0 : cpu_ticks;	// a new thread since last scan. Unknown if the old table overflowed. 
+		idx = idx_Hash;
+		while(pTab_Old[idx].tid != 0)	{
+			if(pTab_Old[idx].tid == tid)	{
+				if(bBusy && pTab_Old[idx].bBusy)	{
+					if(pTab_Old[idx].core != core)	nMigration++;
+					if( (wait_ns >= pTab_Old[idx].wait_ns) && (nSlice >= pTab_Old[idx].nSlice) )	{
+						Core_Wait_ns[core] += (wait_ns - pTab_Old[idx].wait_ns);
+						Core_nSlice[core] += (nSlice - pTab_Old[idx].nSlice);
+					}
+				}
+				if(pRec->tgid == 0)	pRec->tgid = pTab_Old[idx].tgid;
+				Ticks = (cpu_ticks >= pTab_Old[idx].cpu_ticks) ? (cpu_ticks - pTab_Old[idx].cpu_ticks) : 0;
+				break;
+			}
+			idx = (idx+1) & (MAX_TRACKED_THREAD-1);
+			if(idx == idx_Hash)	break;
+		}
+	}
+	if( (pRec->tgid == 0) && ( (Ticks > 0) || bBusy ) )	pRec->tgid = Read_Tgid(tid);	// only needed if the thread is accounted
+	*pid = pRec->tgid;
+	return Ticks;
+}
+
+// Find the record of an executable (pid == 0) or a process in the hash table Tab. Create it if not found. 
+// pOther is returned when the table is 3/4 full, so a node with huge number of apps can not overflow it. 
+APP_REC *Find_App_Rec(APP_REC Tab[], int Used[], int *nUsed, APP_REC *pOther, char szName[], int pid, int *bNew)
+{
+	unsigned int Hash=2166136261U;
+	int i, idx;
+
+	*bNew = 0;
+	if(pid == 0)	{	// FNV-1a hash of the name
+		for(i=0; szName[i] && (i<MAX_APP_NAME_LEN); i++)	Hash = (Hash ^ (unsigned char)szName[i]) * 16777619U;
+	}
+	else	{
+		Hash = pid * 2654435761U;
+	}
+	idx = Hash & (MAX_APP_TRACKED-1);
+
+	while(Tab[idx].szName[0])	{
+		if( (Tab[idx].pid == pid) && ( (pid != 0) || (strncmp(Tab[idx].szName, szName, MAX_APP_NAME_LEN-1) == 0) ) )	return &(Tab[idx]);
+		idx = (idx+1) & (MAX_APP_TRACKED-1);
+	}
+	if(*nUsed >= (MAX_APP_TRACKED*3/4))	return pOther;
+
+	strncpy(Tab[idx].szName, (szName[0]) ? szName : "?", MAX_APP_NAME_LEN-1);
+	Tab[idx].pid = pid;
+	Used[(*nUsed)++] = idx;
+	*bNew = 1;
+	return &(Tab[idx]);
+}
+
+// Threads may have their own names. The CPU time is accounted to the name of the process, i.e., its main thread. 
+void Add_App_CPU(int pid, int tid, char szExeName[], int core, int bBusy, unsigned long long Ticks)
+{
+	APP_REC *pApp, *pProc;
+	int bNew_App, bNew_Proc;
+
+	if(pid == 0)	pid = Read_Tgid(tid);	// not tracked, the thread table is full
+	if(pid <= 0)	pid = tid;
+
+	pProc = Find_App_Rec(Proc_Tab, Proc_Used, &nProc_Used, &Proc_Other, szExeName, pid, &bNew_Proc);
+	if(bNew_Proc && (pid != tid))	Read_Proc_Name(pid, pProc->szName);
+	pApp = Find_App_Rec(App_Tab, App_Used, &nApp_Used, &App_Other, (pProc == &Proc_Other) ? szExeName : pProc->szName, 0, &bNew_App);
+
+	pApp->Ticks += Ticks;
+	pApp->nThread++;
+	if(bNew_Proc)	pApp->nProc++;
+	pProc->Ticks += Ticks;
+	pProc->nThread++;
+	pProc->nProc = 1;
+	if(bBusy)	{
+		pApp->bCore[core >> 3] |= (1 << (core & 7));
+		pProc->bCore[core >> 3] |= (1 << (core & 7));
+	}
+}
+
+void Read_Proc_Name(int pid, char szName[])	// keep szName if the process is gone
+{
+	int fd, num_read;
+	char szPath[64], szBuff[64];
+
+	sprintf(szPath, "/proc/%d/comm", pid);
+	fd = open(szPath, O_RDONLY, 0);
+	if(fd == -1)	return;
+	num_read = read(fd, szBuff, MAX_APP_NAME_LEN-1);
+	close(fd);
+	if(num_read <= 0)	return;
+	szBuff[num_read] = 0;
+	if(szBuff[num_read-1] == '\n')	szBuff[num_read-1] = 0;
+	if(szBuff[0])	strcpy(szName, szBuff);
+}
+
+int Read_Tgid(int tid)	// the process a thread belongs to. Return -1 if not found. 
+{
+	FILE *fIn;
+	char szPath[64], szLine[256];
+	int Tgid=-1;
+
+	sprintf(szPath, "/proc/%d/status", tid);
+	fIn = fopen(szPath, "r");
+	if(fIn == NULL)	return -1;
+	while(fgets(szLine, sizeof(szLine), fIn))	{
+		if(strncmp(szLine, "Tgid:", 5) == 0)	{
+			Tgid = atoi(szLine+5);
+			break;
+		}
+	}
+	fclose(fIn);
+	return Tgid;
+}
+
+void Push_Top_N(APP_REC *Heap[], int *nHeap, APP_REC *pApp)	// min-heap on Ticks. Keep the APP_TOP_N largest. 
+{
+	int i, iChild;
+	APP_REC *pTmp;
+
+	if(*nHeap < APP_TOP_N)	{	// sift up
+		i = (*nHeap)++;
+		Heap[i] = pApp;
+		while( (i > 0) && (Heap[(i-1)/2]->Ticks > Heap[i]->Ticks) )	{
+			pTmp = Heap[i];	Heap[i] = Heap[(i-1)/2];	Heap[(i-1)/2] = pTmp;
+			i = (i-1)/2;
+		}
+		return;
+	}
+	if(pApp->Ticks <= Heap[0]->Ticks)	return;
+
+	Heap[0] = pApp;	// replace the smallest and sift down
+	i = 0;
+	while( (iChild = 2*i+1) < *nHeap )	{
+		if( (iChild+1 < *nHeap) && (Heap[iChild+1]->Ticks < Heap[iChild]->Ticks) )	iChild++;
+		if(Heap[i]->Ticks <= Heap[iChild]->Ticks)	break;
+		pTmp = Heap[i];	Heap[i] = Heap[iChild];	Heap[iChild] = pTmp;
+		i = iChild;
+	}
+}
+
+int Sort_Top_N(APP_REC *Heap[], int nHeap, APP_REC Top[])	// copy the heap into Top[] in descending order
+{
+	int i, j;
+	APP_REC *pTmp;
+
+	for(i=0; i<nHeap; i++)	{	// insertion sort. nHeap is tiny. 
+		for(j=i; (j>0) && (Heap[j]->Ticks > Heap[j-1]->Ticks); j--)	{
+			pTmp = Heap[j];	Heap[j] = Heap[j-1];	Heap[j-1] = pTmp;
+		}
+	}
+	for(i=0; i<nHeap; i++)	Top[i] = *(Heap[i]);
+	return nHeap;
+}
+
+void Rank_Apps(double dt)	// the top APP_TOP_N executables and processes by CPU time in last interval
+{
+	APP_REC *Heap[APP_TOP_N];
+	int i, k, nHeap;
+	unsigned long long Sum_Ticks=0;
+
+	nHeap = 0;
+	for(i=0; i<nApp_Used; i++)	{
+		Push_Top_N(Heap, &nHeap, &(App_Tab[App_Used[i]]));
+		Sum_Ticks += App_Tab[App_Used[i]].Ticks;
+	}
+	if(App_Other.nThread > 0)	{
+		Push_Top_N(Heap, &nHeap, &App_Other);
+		Sum_Ticks += App_Other.Ticks;
+	}
+	nTop_App = Sort_Top_N(Heap, nHeap, Top_App);
+
+	nHeap = 0;
+	for(i=0; i<nProc_Used; i++)	Push_Top_N(Heap, &nHeap, &(Proc_Tab[Proc_Used[i]]));
+	if(Proc_Other.nThread > 0)	Push_Top_N(Heap, &nHeap, &Proc_Other);
+	nTop_Proc = Sort_Top_N(Heap, nHeap, Top_Proc);
+
+	for(i=0; i<nTop_App; i++)	Top_App[i].CPU = (dt > 0.0) ? (1.0*Top_App[i].Ticks/nClock_Tick/dt) : 0.0;
+	for(i=0; i<nTop_Proc; i++)	Top_Proc[i].CPU = (dt > 0.0) ? (1.0*Top_Proc[i].Ticks/nClock_Tick/dt) : 0.0;
+	Total_App_CPU = (dt > 0.0) ? (1.0*Sum_Ticks/nClock_Tick/dt) : 0.0;
+
+	for(i=0; i<nCore; i++)	{
+		Core_Top_App[i] = -1;
+		for(k=0; k<nTop_App; k++)	{
+			if(Top_App[k].bCore[i >> 3] & (1 << (i & 7)))	{
+				Core_Top_App[i] = k;
+				break;
+			}
+		}
+	}
+}
+
+void Format_Core_List(unsigned char bCore[], char szBuf[], int nMaxLen)	// e.g., "0-3,8,10-11"
+{
+	int i, First, nLen=0;
+	char szItem[32];
+
+	szBuf[0] = 0;
+	for(i=0; i<nCore; i++)	{
+		if( !(bCore[i >> 3] & (1 << (i & 7))) )	continue;
+		First = i;
+		while( (i+1 < nCore) && (bCore[(i+1) >> 3] & (1 << ((i+1) & 7))) )	i++;
+		if(i == First)	sprintf(szItem, "%s%d", (nLen > 0) ? "," : "", First);
+		else	sprintf(szItem, "%s%d-%d", (nLen > 0) ? "," : "", First, i);
+		if(nLen + (int)strlen(szItem) > nMaxLen-4)	{
+			strcpy(szBuf+nLen, "...");
+			return;
+		}
+		strcpy(szBuf+nLen, szItem);
+		nLen += strlen(szItem);
+	}
+}
+
+int Init_Uring(void)	// return 0 if io_uring is not available. The plain syscall path will be used. 
+{
+#ifdef HAVE_IO_URING
+	struct io_uring_params Params;
+	struct iovec iov;
+	char *p_SQ, *p_CQ;
+	int Files[URING_BATCH], i, tid, Len;
+
+	memset(&Params, 0, sizeof(Params));
+	Uring.p_SQ = Uring.p_CQ = Uring.Buf = (char*)MAP_FAILED;
+	Uring.sqes = (struct io_uring_sqe*)MAP_FAILED;
+	Uring.fd = syscall(__NR_io_uring_setup, 3*URING_BATCH, &Params);	// open, read and close per file
+	if(Uring.fd < 0)	return 0;
+
+	Uring.sq_size = Params.sq_off.array + Params.sq_entries*sizeof(unsigned);
+	Uring.cq_size = Params.cq_off.cqes + Params.cq_entries*sizeof(struct io_uring_cqe);
+	if(Params.features & IORING_FEAT_SINGLE_MMAP)	{
+		if(Uring.cq_size > Uring.sq_size)	Uring.sq_size = Uring.cq_size;
+		Uring.cq_size = Uring.sq_size;
+	}
+	Uring.p_SQ = p_SQ = (char*)mmap(0, Uring.sq_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, Uring.fd, IORING_OFF_SQ_RING);
+	if(p_SQ == MAP_FAILED)	goto Fail;
+	if(Params.features & IORING_FEAT_SINGLE_MMAP)	p_CQ = p_SQ;
+	else	{
+		Uring.p_CQ = p_CQ = (char*)mmap(0, Uring.cq_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, Uring.fd, IORING_OFF_CQ_RING);
+		if(p_CQ == MAP_FAILED)	goto Fail;
+	}
+	Uring.sqes_size = Params.sq_entries*sizeof(struct io_uring_sqe);
+	Uring.sqes = (struct io_uring_sqe*)mmap(0, Uring.sqes_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, Uring.fd, IORING_OFF_SQES);
+	if(Uring.sqes == MAP_FAILED)	goto Fail;
+
+	Uring.sq_head = (unsigned*)(p_SQ + Params.sq_off.head);
+	Uring.sq_tail = (unsigned*)(p_SQ + Params.sq_off.tail);
+	Uring.sq_mask = (unsigned*)(p_SQ + Params.sq_off.ring_mask);
+	Uring.sq_array = (unsigned*)(p_SQ + Params.sq_off.array);
+	Uring.cq_head = (unsigned*)(p_CQ + Params.cq_off.head);
+	Uring.cq_tail = (unsigned*)(p_CQ + Params.cq_off.tail);
+	Uring.cq_mask = (unsigned*)(p_CQ + Params.cq_off.ring_mask);
+	Uring.cqes = (struct io_uring_cqe*)(p_CQ + Params.cq_off.cqes);
+
+	Uring.Buf = (char*)mmap(0, URING_BATCH*URING_SLOT_SIZE, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+	if(Uring.Buf == MAP_FAILED)	goto Fail;
+	iov.iov_base = Uring.Buf;
+	iov.iov_len = URING_BATCH*URING_SLOT_SIZE;
+	if(syscall(__NR_io_uring_register, Uring.fd, IORING_REGISTER_BUFFERS, &iov, 1) < 0)	goto Fail;
+
+	for(i=0; i<URING_BATCH; i++)	{
+		Files[i] = -1;	// empty slots. Files are opened directly into them. 
+	}
+	if(syscall(__NR_io_uring_register, Uring.fd, IORING_REGISTER_FILES, Files, URING_BATCH) < 0)	goto Fail;
+
+	tid = getpid();	// make sure the kernel supports opening into fixed file slots (5.15+)
+	if( (Uring_Read_Batch(1, &tid, "/proc/%d/task/%d/stat", &Len) == 0) || (Len <= 0) )	goto Fail;
+
+	return 1;
+
+Fail:
+	Close_Uring();
+	return 0;
+#else
+	return 0;
+#endif
+}
+
+void Close_Uring(void)	// unmap the rings and the buffer set up so far and close the ring
+{
+#ifdef HAVE_IO_URING
+	if(Uring.Buf != MAP_FAILED)	munmap(Uring.Buf, URING_BATCH*URING_SLOT_SIZE);
+	if(Uring.sqes != MAP_FAILED)	munmap(Uring.sqes, Uring.sqes_size);
+	if(Uring.p_CQ != MAP_FAILED)	munmap(Uring.p_CQ, Uring.cq_size);
+	if(Uring.p_SQ != MAP_FAILED)	munmap(Uring.p_SQ, Uring.sq_size);
+	Uring.p_SQ = Uring.p_CQ = Uring.Buf = (char*)MAP_FAILED;
+	Uring.sqes = (struct io_uring_sqe*)MAP_FAILED;
+	close(Uring.fd);	// also drops the registered buffer and files
+	Uring.fd = -1;
+#endif
+}
+
+// Read /proc files of n threads into the slots of Uring.Buf with one io_uring_enter() in most cases. 
+// Len[] holds the number of bytes read or a negative error. Return 0 if io_uring fails. 
+// szFormat takes the tid twice, e.g., "/proc/%d/task/%d/stat". 
+int Uring_Read_Batch(int n, int tid[], const char *szFormat, int Len[])
+{
+#ifdef HAVE_IO_URING
+	struct io_uring_sqe *sqe;
+	struct io_uring_cqe *cqe;
+	unsigned tail, head, cq_tail, mask=*Uring.sq_mask;
+	int i, ret, nDone=0, nSubmitted=0, nOp=3*n;
+
+	tail = *Uring.sq_tail;
+	for(i=0; i<n; i++)	{
+		sprintf(Uring.szPath[i], szFormat, tid[i], tid[i]);
+		Len[i] = -1;
+
+		sqe = &(Uring.sqes[tail & mask]);	// open into fixed file slot i
+		memset(sqe, 0, sizeof(struct io_uring_sqe));
+		sqe->opcode = IORING_OP_OPENAT;
+		sqe->fd = AT_FDCWD;
+		sqe->addr = (unsigned long)Uring.szPath[i];
+		sqe->open_flags = O_RDONLY;
+		sqe->file_index = i+1;
+		sqe->flags = IOSQE_IO_LINK;
+		sqe->user_data = 3*i;
+		Uring.sq_array[tail & mask] = tail & mask;
+		tail++;
+
+		sqe = &(Uring.sqes[tail & mask]);	// read into fixed buffer slot i. Skipped if open fails. 
+		memset(sqe, 0, sizeof(struct io_uring_sqe));
+		sqe->opcode = IORING_OP_READ_FIXED;
+		sqe->fd = i;
+		sqe->addr = (unsigned long)(Uring.Buf + i*URING_SLOT_SIZE);
+		sqe->len = URING_SLOT_SIZE-1;
+		sqe->buf_index = 0;
+		sqe->flags = IOSQE_FIXED_FILE | IOSQE_IO_HARDLINK;	// close even if read fails
+		sqe->user_data = 3*i+1;
+		Uring.sq_array[tail & mask] = tail & mask;
+		tail++;
+
+		sqe = &(Uring.sqes[tail & mask]);
+		memset(sqe, 0, sizeof(struct io_uring_sqe));
+		sqe->opcode = IORING_OP_CLOSE;
+		sqe->file_index = i+1;
+		sqe->user_data = 3*i+2;
+		Uring.sq_array[tail & mask] = tail & mask;
+		tail++;
+	}
+	__atomic_store_n(Uring.sq_tail, tail, __ATOMIC_RELEASE);
+
+	head = *Uring.cq_head;
+	while(nDone < nOp)	{
+		cq_tail = __atomic_load_n(Uring.cq_tail, __ATOMIC_ACQUIRE);
+		if(head == cq_tail)	{
+			if(nSubmitted < nOp)	{	// submit the rest and wait for all. The kernel does not wait if it took only a part of the SQEs. 
+				ret = syscall(__NR_io_uring_enter, Uring.fd, nOp-nSubmitted, nOp-nDone, IORING_ENTER_GETEVENTS, NULL, 0);
+				nFile_Syscall++;
+				if(ret > 0)	{
+					nSubmitted += ret;
+					continue;
+				}
+				if(ret == 0)	return 0;
+				if(errno == EINTR)	continue;	// a signal came before anything was submitted
+				if( ( (errno != EAGAIN) && (errno != EBUSY) ) || (nSubmitted == nDone) )	return 0;	// no room and nothing in flight to free it
+				ret = syscall(__NR_io_uring_enter, Uring.fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0);	// out of room. Reap some completions first. 
+			}
+			else	{	// wait for the rest of what was submitted
+				ret = syscall(__NR_io_uring_enter, Uring.fd, 0, nSubmitted-nDone, IORING_ENTER_GETEVENTS, NULL, 0);
+			}
+			nFile_Syscall++;
+			if( (ret < 0) && (errno != EINTR) )	return 0;
+			continue;
+		}
+		while( (head != cq_tail) && (nDone < nOp) )	{
+			cqe = &(Uring.cqes[head & *Uring.cq_mask]);
+			if( (cqe->user_data % 3) == 1 )	Len[cqe->user_data/3] = cqe->res;
+			head++;
+			nDone++;
+		}
+		__atomic_store_n(Uring.cq_head, head, __ATOMIC_RELEASE);
+	}
+
+	for(i=0; i<n; i++)	{
+		if(Len[i] >= 0)	Uring.Buf[i*URING_SLOT_SIZE + Len[i]] = 0;
+	}
+	return 1;
+#else
+	return 0;
+#endif
+}
+
+void Flush_Uring_Batch(void)	// check the threads queued in Uring_Batch_Tid[]
+{
+#ifdef HAVE_IO_URING
+	int i, k, n=nUring_Batch, Len[URING_BATCH], Core[URING_BATCH], bBusy[URING_BATCH], Busy_Idx[URING_BATCH], Busy_Tid[URING_BATCH], nBusy=0;
+	char szExeName[512], Name[URING_BATCH][MAX_APP_NAME_LEN+1];
+	float utime;
+	unsigned long long cpu_ticks[URING_BATCH], run_ns[URING_BATCH], wait_ns[URING_BATCH], nSlice[URING_BATCH];
+
+	nUring_Batch = 0;
+	if(Uring_Read_Batch(n, Uring_Batch_Tid, "/proc/%d/task/%d/stat", Len) == 0)	{	// fall back to the plain syscall path
+		bUring = 0;
+		for(i=0; i<n; i++)	{
+			nThread_Scanned--;
+			Check_Thread(Uring_Batch_Pid[i], Uring_Batch_Tid[i]);
+		}
+		return;
+	}
+
+	for(i=0; i<n; i++)	{
+		bBusy[i] = 0;
+		Name[i][0] = 0;
+		run_ns[i] = wait_ns[i] = nSlice[i] = 0;
+		if(Len[i] <= 0)	continue;	// the thread is gone
+		bBusy[i] = Parse_Thread_Stat(Uring.Buf + i*URING_SLOT_SIZE, szExeName, &(Core[i]), &utime, &(cpu_ticks[i])) && (utime > 1.0);	// running and larger than 1 s. 
+		snprintf(Name[i], sizeof(Name[i]), "%.*s", MAX_APP_NAME_LEN, szExeName);
+		if(bBusy[i])	{
+			Busy_Idx[nBusy] = i;
+			Busy_Tid[nBusy] = Uring_Batch_Tid[i];
+			nBusy++;
+		}
+	}
+
+	if(nBusy > 0)	{	// schedstat of the busy threads only. The buffer slots are reused. 
+		if(Uring_Read_Batch(nBusy, Busy_Tid, "/proc/%d/task/%d/schedstat", Len) == 0)	{
+			bUring = 0;	// the ring may hold unsubmitted entries. Use the plain path from now on. 
+			for(k=0; k<nBusy; k++)	Len[k] = -1;
+		}
+		for(k=0; k<nBusy; k++)	{
+			i = Busy_Idx[k];
+			if( (Len[k] <= 0) || (sscanf(Uring.Buf + k*URING_SLOT_SIZE, "%llu%llu%llu", &(run_ns[i]), &(wait_ns[i]), &(nSlice[i])) != 3) )	{
+				run_ns[i] = wait_ns[i] = nSlice[i] = 0;	// schedstat is not available
+			}
+		}
+	}
+
+	for(i=0; i<n; i++)	{
+		if(Name[i][0] == 0)	continue;	// the thread is gone
+		Account_Thread(Uring_Batch_Pid[i], Uring_Batch_Tid[i], Name[i], Core[i], bBusy[i], cpu_ticks[i], run_ns[i], wait_ns[i], nSlice[i]);
+	}
+#endif
+}
+
+void Bench_Scan(int nScan)	// compare the plain syscall path and io_uring for the task scan
+{
+	struct timeval tv_Start, tv_End, tv_Diff;
+	double dt;
+	int i, Mode, bHave_Uring;
+
+	bHave_Uring = bUring ? 1 : Init_Uring();	// reuse the ring set up by "uring"
+	for(Mode=0; Mode<2; Mode++)	{
+		if( (Mode == 1) && (bHave_Uring == 0) )	{
+			printf("io_uring   is not available.\n");
+			break;
+		}
+		bUring = Mode;
+		Enumerate_All_PID();	// warm up
+		nFile_Syscall = 0;
+		nThread_Scanned = 0;
+		gettimeofday(&tv_Start, 0);
+		for(i=0; i<nScan; i++)	{
+			Enumerate_All_PID();
+		}
+		gettimeofday(&tv_End, 0);
+		timersub(&tv_End, &tv_Start, &tv_Diff);
+		dt = tv_Diff.tv_sec + 0.000001*tv_Diff.tv_usec;
+		printf("%-10s %9.3f ms per scan, %7d threads, %10.1f syscalls on per-thread files per scan\n", (Mode == 0) ? "syscall" : "io_uring", 1000.0*dt/nScan, nThread_Scanned/nScan, 1.0*nFile_Syscall/nScan);
+	}
+}
+
+int Read_Sched_Stat(int tid, unsigned long long *run_ns, unsigned long long *wait_ns, unsigned long long *nSlice)
+{
+	int fd, num_read;
+	char szName[64], szBuff[128];
+
+	sprintf(szName, "/proc/%d/task/%d/schedstat", tid, tid);
+	fd = open(szName, O_RDONLY, 0);
+	if(fd == -1)	return 0;
+	num_read = read(fd, szBuff, 127);
+	close(fd);
+	nFile_Syscall += 3;
+	if(num_read <= 0)	return 0;
+	szBuff[num_read] = 0;
+
+	if(sscanf(szBuff, "%llu%llu%llu", run_ns, wait_ns, nSlice) != 3)	return 0;
+	return 1;
+}
+
+void Read_NUMA_Node_Info(void)
+{
+	DIR *dp;
+	struct dirent *ep;
+	char szPath[512];
+	int i, node, bInNode[MAX_CORE];
+
+	for(i=0; i<nCore; i++)	{
+		NodeID[i] = SocketID[i];	// default
+	}
+
+	dp = opendir("/sys/devices/system/node");
+	if(dp == NULL)	return;
+
+	while( (ep = readdir(dp)) )	{
+		if(strncmp(ep->d_name, "node", 4) != 0)	continue;
+		if( (ep->d_name[4] < '0') || (ep->d_name[4] > '9') )	continue;
+		node = atoi(ep->d_name+4);
+		if(node >= MAX_CORE)	continue;
+
+		sprintf(szPath, "/sys/devices/system/node/%s/cpulist", ep->d_name);
+		if(Read_CPU_List(szPath, bInNode) == 0)	continue;
+		for(i=0; i<nCore; i++)	{
+			if(bInNode[i])	NodeID[i] = node;
+		}
+	}
+	closedir(dp);
+}
+
+int Read_CPU_List(char szFile[], int bInList[])	// parse a cpu list file like "0-3,8-11". Return 0 if the file is not readable. 
+{
+	FILE *fIn;
+	char szLine[8192], *p;
+	int i, first, last;
+
+	memset(bInList, 0, sizeof(int)*MAX_CORE);
+
+	fIn = fopen(szFile, "r");
+	if(fIn == NULL)	return 0;
+	if(fgets(szLine, 8192, fIn) == NULL)	{
+		fclose(fIn);
+		return 0;
+	}
+	fclose(fIn);
+
+	p = szLine;
+	while( (*p >= '0') && (*p <= '9') )	{
+		first = last = strtol(p, &p, 10);
+		if(*p == '-')	last = strtol(p+1, &p, 10);
+		for(i=first; (i<=last) && (i<MAX_CORE); i++)	{
+			bInList[i] = 1;
+		}
+		if(*p == ',')	p++;
+	}
+	return 1;
+}
+
+void Setup_Core_Layout(void)	// build the list of displayed cores and the rows of the terminal version
+{
+	int i, key, Key_Row[MAX_CORE];
+
+	if(nCore_Socket <= 0)	nCore_Socket = nCore;
+	nCore_Shown = 0;
+	for(i=0; i<nCore; i++)	{
+		if(bCore_Shown[i])	Core_Shown_List[nCore_Shown++] = i;
+	}
+
+	for(i=0; i<MAX_CORE; i++)	{
+		Key_Row[i] = -1;
+	}
+	for(i=0; i<nCore; i++)	{
+		key = CoreID[i] + SocketID[i]*nCore_Socket;	// physical core index on the node
+		if( bCore_Shown[i] && (key >= 0) && (key < MAX_CORE) )	Key_Row[key] = 1;
+	}
+
+	nCPU = 0;	// the number of physical cores displayed
+	for(key=0; key<MAX_CORE; key++)	{
+		if(Key_Row[key] < 0)	continue;
+		Key_Row[key] = nCPU;
+		Row_Label[nCPU] = key;
+		bRow_Socket_Start[nCPU] = (nCPU == 0) || ( (key/nCore_Socket) != (Row_Label[nCPU-1]/nCore_Socket) );
+		nCPU++;
+	}
+
+	for(i=0; i<nCore; i++)	{
+		key = CoreID[i] + SocketID[i]*nCore_Socket;
+		Row_Core[i] = ( bCore_Shown[i] && (key >= 0) && (key < MAX_CORE) ) ? Key_Row[key] : -1;
+	}
+}
+
+void Setup_Cgroup(char szPath[])	// szPath is NULL to discover the cgroup of myself
+{
+	FILE *fIn;
+	char szLine[1024], szRel_V2[1024]="/", szRel_Cpuset[1024]="/", szRel_CPU[1024]="/", szCtrl[256], *p, *p_Job;
+	char szFile[1024], szCPU_Dir[512]="";
+	int bInSet[MAX_CORE], i, n, bFound_V2=0, bFound_Cpuset=0, bFit=1;
+	struct stat file_stat;
+
+	if(szPath)	{
+		if(strncmp(szPath, "/sys/", 5) == 0)	bFit &= Format_Path(szCgroup_Dir, sizeof(szCgroup_Dir), "%s%s", "", szPath);
+		else	bFit &= Format_Path(szCgroup_Dir, sizeof(szCgroup_Dir), "/sys/fs/cgroup%s%s", (szPath[0] == '/') ? "" : "/", szPath);
+		snprintf(szCPU_Dir, sizeof(szCPU_Dir), "%s", szCgroup_Dir);
+	}
+	else	{
+		fIn = fopen("/proc/self/cgroup", "r");	// lines like "0::/path" (v2) or "3:cpuset:/path" (v1)
+		if(fIn == NULL)	{
+			printf("Fail to open file: /proc/self/cgroup\nQuit\n");
+			exit(1);
+		}
+		while(fgets(szLine, 1024, fIn))	{
+			p = strchr(szLine, '\n');
+			if(p)	*p = 0;
+			p = strchr(szLine, ':');
+			if(p == NULL)	continue;
+			n = sscanf(p+1, "%255[^:]", szCtrl);
+			p = strchr(p+1, ':');
+			if(p == NULL)	continue;
+			p++;
+			p_Job = strstr(p, "/job_");	// Slurm. Monitor the whole job instead of the step I am in. 
+			if(p_Job)	{
+				p_Job = strchr(p_Job+1, '/');
+				if(p_Job)	*p_Job = 0;
+			}
+			if(n != 1)	{	// "0::/path", empty controller list
+				snprintf(szRel_V2, sizeof(szRel_V2), "%s", p);
+				bFound_V2 = 1;
+			}
+			else if(strcmp(szCtrl, "cpuset") == 0)	{
+				snprintf(szRel_Cpuset, sizeof(szRel_Cpuset), "%s", p);
+				bFound_Cpuset = 1;
+			}
+			else if( (strcmp(szCtrl, "cpu,cpuacct") == 0) || (strcmp(szCtrl, "cpu") == 0) || (strcmp(szCtrl, "cpuacct,cpu") == 0) )	snprintf(szRel_CPU, sizeof(szRel_CPU), "%s", p);
+		}
+		fclose(fIn);
+
+		if(stat("/sys/fs/cgroup/cgroup.controllers", &file_stat) == 0)	{	// unified hierarchy (cgroup v2)
+			bFit &= Format_Path(szCgroup_Dir, sizeof(szCgroup_Dir), "%s%s", "/sys/fs/cgroup", szRel_V2);
+			snprintf(szCPU_Dir, sizeof(szCPU_Dir), "%s", szCgroup_Dir);
+		}
+		else if(bFound_Cpuset)	{	// cgroup v1, or hybrid with the cpuset controller on v1
+			bFit &= Format_Path(szCgroup_Dir, sizeof(szCgroup_Dir), "%s%s", "/sys/fs/cgroup/cpuset", szRel_Cpuset);
+			bFit &= Format_Path(szCPU_Dir, sizeof(szCPU_Dir), "%s%s", "/sys/fs/cgroup/cpu,cpuacct", szRel_CPU);
+			if(stat(szCPU_Dir, &file_stat) != 0)	Format_Path(szCPU_Dir, sizeof(szCPU_Dir), "%s%s", "/sys/fs/cgroup/cpu", szRel_CPU);	// shorter than the line above
+		}
+		else if(bFound_V2)	{	// hybrid without a v1 cpuset. The v2 tree is mounted at unified/. 
+			bFit &= Format_Path(szCgroup_Dir, sizeof(szCgroup_Dir), "%s%s", "/sys/fs/cgroup/unified", szRel_V2);
+			snprintf(szCPU_Dir, sizeof(szCPU_Dir), "%s", szCgroup_Dir);
+		}
+		else	{
+			printf("No cpuset or unified cgroup found in /proc/self/cgroup.\nQuit\n");
+			exit(1);
+		}
+	}
+
+	bFit &= Format_Path(szCgroup_CPU_Stat, sizeof(szCgroup_CPU_Stat), "%s/%s", szCPU_Dir, "cpu.stat");
+	if(bFit == 0)	{
+		printf("The path of the cgroup is too long.\nQuit\n");
+		exit(1);
+	}
+
+	snprintf(szFile, sizeof(szFile), "%s/cgroup.threads", szCgroup_Dir);	// szFile is large enough for szCgroup_Dir and the file names below
+	if(stat(szFile, &file_stat) == 0)	strcpy(szCgroup_Task_File, "cgroup.threads");
+	else	{
+		snprintf(szFile, sizeof(szFile), "%s/tasks", szCgroup_Dir);
+		if(stat(szFile, &file_stat) != 0)	{
+			printf("%s is not a valid cgroup.\nQuit\n", szCgroup_Dir);
+			exit(1);
+		}
+		strcpy(szCgroup_Task_File, "tasks");
+	}
+
+	snprintf(szFile, sizeof(szFile), "%s/cpuset.cpus.effective", szCgroup_Dir);	// v2
+	if(Read_CPU_List(szFile, bInSet) == 0)	{
+		snprintf(szFile, sizeof(szFile), "%s/cpuset.effective_cpus", szCgroup_Dir);	// v1
+		if(Read_CPU_List(szFile, bInSet) == 0)	{
+			for(i=0; i<MAX_CORE; i++)	bInSet[i] = 1;	// no cpuset info. Show all cores. 
+		}
+	}
+	n = 0;
+	for(i=0; i<nCore; i++)	{
+		bCore_Shown[i] = bInSet[i];
+		n += bInSet[i];
+	}
+	if(n == 0)	{	// something is wrong. Fall back to all cores. 
+		for(i=0; i<nCore; i++)	bCore_Shown[i] = 1;
+		n = nCore;
+	}
+
+	bCgroup = 1;
+	printf("Monitoring cgroup %s with %d cores.\n", szCgroup_Dir, n);
+}
+
+void Enumerate_Cgroup_Tasks(char szDir[])	// check all threads in szDir and its child cgroups
+{
+	FILE *fIn;
+	DIR *dp;
+	struct dirent *ep;
+	char szPath[1024];
+	int tid;
+
+	if(Format_Path(szPath, sizeof(szPath), "%s/%s", szDir, szCgroup_Task_File) == 0)	return;	// too deep. Skip this subtree. 
+	fIn = fopen(szPath, "r");
+	if(fIn)	{
+		while(fscanf(fIn, "%d", &tid) == 1)	{
+			Check_Thread(0, tid);	// the process is looked up later if the thread used CPU
+		}
+		fclose(fIn);
+	}
+
+	dp = opendir(szDir);
+	if(dp == NULL)	return;
+	while( (ep = readdir(dp)) )	{
+		if(ep->d_type != DT_DIR)	continue;
+		if(ep->d_name[0] == '.')	continue;
+		if(Format_Path(szPath, sizeof(szPath), "%s/%s", szDir, ep->d_name) == 0)	continue;
+		Enumerate_Cgroup_Tasks(szPath);
+	}
+	closedir(dp);
+}
+
+int Format_Path(char szDest[], size_t nSize, const char szFmt[], const char szA[], const char szB[])	// snprintf() of two strings. Return 0 if truncated. 
+{
+	int n;
+
+	n = snprintf(szDest, nSize, szFmt, szA, szB);
+	return ( (n >= 0) && ((size_t)n < nSize) );
+}
+
+int Read_Cgroup_CPU_Stat(unsigned long long *nPeriod, unsigned long long *nThrottled, unsigned long long *Throttled_ns)
+{
+	FILE *fIn;
+	char szKey[64];
+	unsigned long long Value;
+	int nFound=0;
+
+	fIn = fopen(szCgroup_CPU_Stat, "r");
+	if(fIn == NULL)	return 0;
+	while(fscanf(fIn, "%63s%llu", szKey, &Value) == 2)	{
+		if(strcmp(szKey, "nr_periods") == 0)	{
+			*nPeriod = Value;
+			nFound++;
+		}
+		else if(strcmp(szKey, "nr_throttled") == 0)	{
+			*nThrottled = Value;
+			nFound++;
+		}
+		else if(strcmp(szKey, "throttled_usec") == 0)	{	// v2
+			*Throttled_ns = 1000*Value;
+			nFound++;
+		}
+		else if(strcmp(szKey, "throttled_time") == 0)	{	// v1 in nanoseconds
+			*Throttled_ns = Value;
+			nFound++;
+		}
+	}
+	fclose(fIn);
+
+	return (nFound == 3);
+}
+
+void Analyze_Placement(void)	// find cores shared by multiple busy threads of mine while other cores on the same node are idle
+{
+	int i, Idle_on_Node[MAX_CORE];
+
+	memset(Idle_on_Node, 0, sizeof(int)*MAX_CORE);
+	nCore_OverSub = nCore_Idle = 0;
+
+	for(i=0; i<nCore; i++)	{
+		if( bCore_Shown[i] && (nApp_Core[i] == 0) && (Core_Usage[i] < IDLE_THRESHOLD) )	{
+			Idle_on_Node[NodeID[i]]++;
+			nCore_Idle++;
+		}
+	}
+	for(i=0; i<nCore; i++)	{
+		if(nApp_Core[i] > 1)	{
+			nCore_OverSub++;
+			bOverSub_Core[i] = (Idle_on_Node[NodeID[i]] > 0) ? 2 : 1;
+		}
+		else	{
+			bOverSub_Core[i] = 0;
+		}
+	}
+}
+
+#define SIZE_STAT	(360)
+
+int Extract_Exec_Name(int pid, char szExeName[], int* core, float* utime, unsigned long long *cpu_ticks)	// return 1 if running, -1 if the thread is gone
+{
+	int fd;
+	char szPath[512];
+	int num_read;
+	char szBuff[SIZE_STAT+16];
 	
 	szExeName[0] = 0;
 	*core = 0;
 
-	sprintf(szPath, "/proc/%d/stat", pid);
-	fIn = fopen(szPath, "r");	// open, read the file take 2.4 milliseconds. KNL is 3 times slower than haswell. 
-	if(fIn == 0)	return;
+	sprintf(szPath, "/proc/%d/task/%d/stat", pid, pid);	// per-thread stat. /proc/<tid>/stat walks the whole thread group. 
+	fd = open(szPath, O_RDONLY, 0);	// open, read the file take 2.4 milliseconds. KNL is 3 times slower than haswell. 
+	if(fd == -1)	return -1;
 
-	num_read = fread(szBuff, 1, nLen, fIn);
-	fclose(fIn);
+	num_read = read(fd, szBuff, SIZE_STAT);
+	close(fd);
+	nFile_Syscall += 3;
+	if(num_read <= 0)	return -1;
+	szBuff[num_read] = 0;
 	
+	return Parse_Thread_Stat(szBuff, szExeName, core, utime, cpu_ticks);
+}
+
+int Parse_Thread_Stat(char szBuff[], char szExeName[], int* core, float* utime, unsigned long long *cpu_ticks)	// return 1 if the thread is running
+{
+	int count=0, IsRunning=0;
+	char *pch, *str;
+
+	szExeName[0] = 0;
+	*core = 0;
+	*utime = 0.0;
+	*cpu_ticks = 0;
+
 	pch = strtok (szBuff," \t");
 	while (pch != NULL)
 	{
 		if(count == 1)	{	// exe name
 			strncpy(szExeName, pch+1, MAX_APP_NAME_LEN);
+			szExeName[MAX_APP_NAME_LEN] = 0;
 			str = strstr(szExeName, ")");
-			str[0] = 0;	// remove the last ')'
+			if(str)	str[0] = 0;	// remove the last ')'
 		}
-		if(count == 13)	{
+		else if(count == 2)	{
+			IsRunning = (pch[0] == 'R');
+		}
+		else if(count == 13)	{
 			*utime = (float)atof(pch);
+			*cpu_ticks += strtoull(pch, NULL, 10);
+		}
+		else if(count == 14)	{	// stime
+			*cpu_ticks += strtoull(pch, NULL, 10);
 		}
 		else if(count == 38)	{	// core
 			*core = atoi(pch);
@@ -888,31 +3197,17 @@ void Extract_Exec_Name(int pid, char szExeName[], int* core, float* utime)
 		pch = strtok (NULL, " \t");
 		count++;
 	}
-}
-
-int Is_Thread_Running(char szName[])
-{
-	int fd;
-	int num_read, ReadItems, pid, ppid;
-	char szBuff[256];
-	char RunningStatus[64], szExeName[128];
-	
-	fd = open(szName, O_RDONLY, 0);	// open, read the file take 2.4 milliseconds. KNL is 3 times slower than haswell. 
-	if(fd == -1)	return 0;
-	num_read = read(fd, szBuff, 256);
-	close(fd);
-	
-	ReadItems = sscanf(szBuff, "%d%s%s%d", &pid, szExeName, RunningStatus, &ppid);
-	if(RunningStatus[0] == 'R')	return 1;
-	else	return 0;
+	return IsRunning;
 }
 
 void Output_Core_Usage(void)
 {
 	char szName[128];
 	FILE *fLog;
-	int i;
+	int i, k;
+	struct timeval tv_Now;
 
+	gettimeofday(&tv_Now, 0);	// wall clock. Drift of the update timer shows up here, not in t. 
 	sprintf(szName, "log_core_usage_%s.txt", szHostName);
 	fLog = fopen(szName, "a+");
 	if(fLog == NULL)	{
@@ -922,20 +3217,21 @@ void Output_Core_Usage(void)
 	
 	if(nCountLog == 0)	{
 		fprintf(fLog, "     t   ");
-		for(i=0; i<nCore; i++)	{
+		for(k=0; k<nCore_Shown; k++)	{
+			i = Core_Shown_List[k];
 			if(i<10)	{
 				fprintf(fLog, "c-%d  ", i);
 			}
 			else fprintf(fLog, "c-%d ", i);
 		}
-		fprintf(fLog, "\n");
+		fprintf(fLog, " n_ovs n_idle   mig/s          wall_t\n");
 	}
 
 	fprintf(fLog, " %7.1lf ", tNow);
-	for(i=0; i<nCore; i++)  {
-		fprintf(fLog, "%4.2lf ", Core_Usage[i]);
+	for(k=0; k<nCore_Shown; k++)  {
+		fprintf(fLog, "%4.2lf ", Core_Usage[Core_Shown_List[k]]);
 	}
-	fprintf(fLog, "\n");
+	fprintf(fLog, " %5d %6d %7.1f %15.3lf\n", nCore_OverSub, nCore_Idle, Migration_Rate, tv_Now.tv_sec + 0.000001*tv_Now.tv_usec);
 	fclose(fLog);
 	tNow += tInterval;
 	nCountLog++;
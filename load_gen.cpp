@@ -0,0 +1,402 @@
+/*************************************************************************
+--------------------------------------------------------------------------
+--  core_usage License
+--------------------------------------------------------------------------
+--
+--  core_usage is licensed under the terms of the MIT license reproduced
+--  below. This means that core_usage is free software and can be used for
+--  both academic and commercial purposes at absolutely no cost.
+--
+--  ----------------------------------------------------------------------
+--
+--  Copyright (C) 2017-2019 Lei Huang
+--
+--  Permission is hereby granted, free of charge, to any person obtaining
+--  a copy of this software and associated documentation files (the
+--  "Software"), to deal in the Software without restriction, including
+--  without limitation the rights to use, copy, modify, merge, publish,
+--  distribute, sublicense, and/or sell copies of the Software, and to
+--  permit persons to whom the Software is furnished to do so, subject
+--  to the following conditions:
+--
+--  The above copyright notice and this permission notice shall be
+--  included in all copies or substantial portions of the Software.
+--
+--  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+--  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+--  OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+--  NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+--  BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+--  ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+--  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+--  THE SOFTWARE.
+--
+--------------------------------------------------------------------------
+*************************************************************************/
+
+
+// Compile: g++ -O2 -o load_gen load_gen.cpp -lpthread
+// Run:     ./load_gen [t_run] <core>:<duty>[:<period>] ... [check <log>] [tol <err>]
+//          t_run  - how long (in seconds) the load runs. 30 by default.
+//          core   - the logic core the thread is pinned to
+//          duty   - the busy percentage of the thread, e.g., 25, 50, 100
+//          period - optional. Square wave of this period (in seconds). The
+//                   thread runs at duty in the first half and sleeps in
+//                   the second half of each period.
+//          check  - compare the samples in the log of core_usage
+//                   (LOG_CORE_USAGE=1) with the expected pattern and report
+//                   the error and detection latency of each core.
+//          ./load_gen 20 0:25 1:50 2:100 3:100:4 check log_core_usage_`hostname`.txt
+
+// A synthetic load to validate the accuracy and the latency of core_usage.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+
+#define MAX_LOAD	(256)
+#define MAX_EDGE	(4096)
+#define MAX_COL	(1024+16)	// the columns in a log line. MAX_CORE of core_usage plus the summary
+#define PWM_SLICE	(0.01)	// 10 ms. Much shorter than the update interval of core_usage.
+#define T_LEAD	(1.0)	// the load starts one second later, so the rising edge can be seen.
+#define T_TAIL	(3.0)	// wait for core_usage to log the falling edge before checking
+#define T_STEP	(0.001)	// the step to integrate the expected usage
+
+typedef struct	{
+	int core;
+	float duty;	// 0.0 - 1.0
+	float period;	// 0 means constant load
+	pthread_t thread;
+}LOAD_SPEC;
+
+typedef struct	{	// the result of one checked core
+	int core;
+	int nSample, nEdge, nDetected, nMissed;
+	double Sum_Err, Max_Err, Sum_Latency, Max_Latency;
+	double t_Edge[MAX_EDGE];
+	float Level_Before[MAX_EDGE], Level_After[MAX_EDGE];
+}CORE_CHECK;
+
+LOAD_SPEC Load_List[MAX_LOAD];
+int nLoad=0;
+CORE_CHECK *Check_List=NULL;
+int nCore_Checked=0;
+double t_Start, t_End;
+float tRun=30.0;
+
+double Get_Time(void);
+void Sleep_Until(double t);
+int Parse_Load_Spec(char szSpec[], LOAD_SPEC *pLoad);
+void *Load_Main(void *arg);
+float Load_Level(LOAD_SPEC *pLoad, double t);
+float Core_Level(int core, double t);
+double Expected_Usage(int core, double t0, double t1);
+void Find_Edges(CORE_CHECK *pCheck);
+int Check_Log(char szLog[], float Tolerance);
+
+double Get_Time(void)	// wall clock, the same as gettimeofday() used by core_usage in its log
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return (ts.tv_sec + 1.0E-9*ts.tv_nsec);
+}
+
+void Sleep_Until(double t)
+{
+	struct timespec ts;
+
+	ts.tv_sec = (time_t)t;
+	ts.tv_nsec = (long)((t - ts.tv_sec)*1.0E9);
+	while(clock_nanosleep(CLOCK_REALTIME, TIMER_ABSTIME, &ts, NULL) != 0)	{}	// restart if interrupted
+}
+
+int Parse_Load_Spec(char szSpec[], LOAD_SPEC *pLoad)	// "core:duty[:period]". Return 0 if invalid.
+{
+	int core;
+	float duty, period=0.0;
+
+	if(sscanf(szSpec, "%d:%f:%f", &core, &duty, &period) < 2)	return 0;
+	if( (core < 0) || (duty < 0.0) || (duty > 100.0) || (period < 0.0) )	return 0;
+	if( (period > 0.0) && (period < 4*PWM_SLICE) )	return 0;
+
+	pLoad->core = core;
+	pLoad->duty = 0.01*duty;
+	pLoad->period = period;
+	return 1;
+}
+
+float Load_Level(LOAD_SPEC *pLoad, double t)	// the busy fraction of one thread at time t
+{
+	double phase;
+
+	if( (t < t_Start) || (t >= t_End) )	return 0.0;
+	if(pLoad->period <= 0.0)	return pLoad->duty;
+
+	phase = fmod(t - t_Start, pLoad->period);
+	return (phase < 0.5*pLoad->period) ? pLoad->duty : 0.0;
+}
+
+float Core_Level(int core, double t)
+{
+	int i;
+	float Level=0.0;
+
+	for(i=0; i<nLoad; i++)	{
+		if(Load_List[i].core == core)	Level += Load_Level(&(Load_List[i]), t);
+	}
+	return (Level > 1.0) ? 1.0 : Level;
+}
+
+double Expected_Usage(int core, double t0, double t1)	// the average busy fraction over [t0, t1]
+{
+	double t, Sum=0.0;
+	int n=0;
+
+	for(t=t0+0.5*T_STEP; t<t1; t+=T_STEP)	{
+		Sum += Core_Level(core, t);
+		n++;
+	}
+	return (n > 0) ? (Sum/n) : 0.0;
+}
+
+void *Load_Main(void *arg)	// pulse-width modulation at PWM_SLICE
+{
+	LOAD_SPEC *pLoad = (LOAD_SPEC *)arg;
+	double t_Slice, t_Busy_End;
+	volatile double x=1.0;
+
+	Sleep_Until(t_Start);
+	for(t_Slice=t_Start; t_Slice<t_End; t_Slice+=PWM_SLICE)	{
+		t_Busy_End = t_Slice + Load_Level(pLoad, t_Slice)*PWM_SLICE;
+		while(Get_Time() < t_Busy_End)	{
+			x = x*1.000001 + 0.000001;
+		}
+		Sleep_Until(t_Slice + PWM_SLICE);
+	}
+	return NULL;
+}
+
+void Find_Edges(CORE_CHECK *pCheck)	// where the expected level of the core changes
+{
+	double t;
+	float Level, Level_Old;
+
+	pCheck->nEdge = 0;
+	Level_Old = Core_Level(pCheck->core, t_Start - T_STEP);
+	for(t=t_Start; t<=t_End+T_STEP; t+=T_STEP)	{
+		Level = Core_Level(pCheck->core, t);
+		if(fabs(Level - Level_Old) > 0.05)	{
+			if(pCheck->nEdge >= MAX_EDGE)	break;
+			pCheck->t_Edge[pCheck->nEdge] = t;
+			pCheck->Level_Before[pCheck->nEdge] = Level_Old;
+			pCheck->Level_After[pCheck->nEdge] = Level;
+			pCheck->nEdge++;
+		}
+		Level_Old = Level;
+	}
+}
+
+// Read the log of core_usage. The samples in [t_Start, t_End + T_TAIL] are compared with
+// the expected usage averaged over the same interval. The latency of an edge is the time from
+// the edge to the first sample crossing the midpoint of the two levels.
+// Return the number of cores with the mean error above Tolerance.
+int Check_Log(char szLog[], float Tolerance)
+{
+	FILE *fIn;
+	char szLine[65536], *pch;
+	int Col_Core[MAX_LOAD], k, nCol, Col_Wall=-1, iEdge[MAX_LOAD], nFail=0, nInterval=0;
+	double Value[MAX_COL], t_Wall, t_Prev=-1.0, t_Nominal, t_Nominal_Prev=0.0, Obs, Exp, Err, Mid;
+	double Sum_Interval=0.0, Max_Interval=0.0, Sum_Nominal=0.0, Latency;
+	CORE_CHECK *pCheck;
+
+	fIn = fopen(szLog, "r");
+	if(fIn == NULL)	{
+		printf("Fail to open file: %s\n", szLog);
+		return 1;
+	}
+
+	for(k=0; k<nCore_Checked; k++)	{
+		Col_Core[k] = -1;
+		iEdge[k] = 0;
+		Find_Edges(&(Check_List[k]));
+	}
+
+	while(fgets(szLine, sizeof(szLine), fIn))	{
+		if(strstr(szLine, "c-"))	{	// a header. core_usage writes one every time it starts.
+			Col_Wall = -1;
+			t_Prev = -1.0;
+			for(k=0; k<nCore_Checked; k++)	Col_Core[k] = -1;
+			nCol = 0;
+			for(pch=strtok(szLine, " \t\n"); pch; pch=strtok(NULL, " \t\n"), nCol++)	{
+				if(strcmp(pch, "wall_t") == 0)	Col_Wall = nCol;
+				else if(strncmp(pch, "c-", 2) == 0)	{
+					for(k=0; k<nCore_Checked; k++)	{
+						if(Check_List[k].core == atoi(pch+2))	Col_Core[k] = nCol;
+					}
+				}
+			}
+			continue;
+		}
+		if(Col_Wall < 0)	continue;	// an old log without wall clock
+
+		nCol = 0;
+		for(pch=strtok(szLine, " \t\n"); pch && (nCol < MAX_COL); pch=strtok(NULL, " \t\n"))	{
+			Value[nCol++] = atof(pch);
+		}
+		if(nCol <= Col_Wall)	continue;
+		t_Wall = Value[Col_Wall];
+		t_Nominal = Value[0];
+
+		if( (t_Prev > 0.0) && (t_Wall > t_Start) && (t_Prev < t_End + T_TAIL) )	{
+			nInterval++;
+			Sum_Interval += (t_Wall - t_Prev);
+			Sum_Nominal += (t_Nominal - t_Nominal_Prev);
+			if( (t_Wall - t_Prev) > Max_Interval )	Max_Interval = t_Wall - t_Prev;
+
+			for(k=0; k<nCore_Checked; k++)	{
+				if( (Col_Core[k] < 0) || (Col_Core[k] >= nCol) )	continue;	// not shown by core_usage (e.g., outside of its cgroup)
+				pCheck = &(Check_List[k]);
+				Obs = Value[Col_Core[k]];
+				Exp = Expected_Usage(pCheck->core, t_Prev, t_Wall);
+				Err = fabs(Obs - Exp);
+				pCheck->Sum_Err += Err;
+				if(Err > pCheck->Max_Err)	pCheck->Max_Err = Err;
+				pCheck->nSample++;
+
+				while( (iEdge[k] < pCheck->nEdge) && (pCheck->t_Edge[iEdge[k]] < t_Wall) )	{
+					if( (iEdge[k]+1 < pCheck->nEdge) && (pCheck->t_Edge[iEdge[k]+1] < t_Wall) )	{	// next edge came before detection
+						pCheck->nMissed++;
+						iEdge[k]++;
+						continue;
+					}
+					Mid = 0.5*(pCheck->Level_Before[iEdge[k]] + pCheck->Level_After[iEdge[k]]);
+					if( (pCheck->Level_After[iEdge[k]] > pCheck->Level_Before[iEdge[k]]) ? (Obs >= Mid) : (Obs <= Mid) )	{
+						Latency = t_Wall - pCheck->t_Edge[iEdge[k]];
+						pCheck->Sum_Latency += Latency;
+						pCheck->nDetected++;
+						if(Latency > pCheck->Max_Latency)	pCheck->Max_Latency = Latency;
+						iEdge[k]++;
+					}
+					break;
+				}
+			}
+		}
+		t_Prev = t_Wall;
+		t_Nominal_Prev = t_Nominal;
+	}
+	fclose(fIn);
+
+	if(nInterval == 0)	{
+		printf("No samples of core_usage with wall clock found in %s during the run.\nRun core_usage with LOG_CORE_USAGE=1 at the same time.\n", szLog);
+		return 1;
+	}
+
+	printf("Update interval: nominal %.3f s, measured %.3f s on average, %.3f s at most. Drift %.1f ms over %d samples.\n",
+		Sum_Nominal/nInterval, Sum_Interval/nInterval, Max_Interval, 1000.0*(Sum_Interval - Sum_Nominal), nInterval);
+	printf("core  samples  mean_err  max_err  edges  lat_avg(s)  lat_max(s)  missed\n");
+	for(k=0; k<nCore_Checked; k++)	{
+		pCheck = &(Check_List[k]);
+		if(pCheck->nSample == 0)	{
+			printf("%4d  not found in the log\n", pCheck->core);
+			nFail++;
+			continue;
+		}
+		printf("%4d  %7d  %8.3f  %7.3f  %5d  %10.3f  %10.3f  %6d%s\n", pCheck->core, pCheck->nSample,
+			pCheck->Sum_Err/pCheck->nSample, pCheck->Max_Err, pCheck->nEdge,
+			(pCheck->nDetected > 0) ? (pCheck->Sum_Latency/pCheck->nDetected) : 0.0, pCheck->Max_Latency, pCheck->nMissed,
+			(pCheck->Sum_Err/pCheck->nSample > Tolerance) ? "  FAIL" : "");
+		if(pCheck->Sum_Err/pCheck->nSample > Tolerance)	nFail++;
+	}
+	return nFail;
+}
+
+int main(int argc, char *argv[])
+{
+	int i, k, nCPU;
+	char szName[16], *szLog=NULL;
+	float Tolerance=0.05, Sum_Duty[MAX_LOAD];
+	pthread_attr_t attr;
+	cpu_set_t mask;
+
+	for(i=1; i<argc; i++)	{
+		if( (strcmp(argv[i], "check")==0) && (i+1 < argc) )	{
+			szLog = argv[++i];
+		}
+		else if( (strcmp(argv[i], "tol")==0) && (i+1 < argc) )	{
+			Tolerance = atof(argv[++i]);
+		}
+		else if(strchr(argv[i], ':'))	{
+			if(nLoad >= MAX_LOAD)	{
+				printf("Too many threads. MAX_LOAD = %d\nQuit\n", MAX_LOAD);
+				exit(1);
+			}
+			if(Parse_Load_Spec(argv[i], &(Load_List[nLoad])) == 0)	{
+				printf("Invalid load: %s\nExpected <core>:<duty 0-100>[:<period >= %.2f s>]\nQuit\n", argv[i], 4*PWM_SLICE);
+				exit(1);
+			}
+			nLoad++;
+		}
+		else if( (argv[i][0] >= '0') && (argv[i][0] <= '9') )	{
+			tRun = atof(argv[i]);
+		}
+		else	{
+			printf("Unknown parameter: %s\nQuit\n", argv[i]);
+			exit(1);
+		}
+	}
+	if(nLoad == 0)	{
+		printf("Usage: %s [t_run] <core>:<duty>[:<period>] ... [check <log>] [tol <err>]\n", argv[0]);
+		exit(1);
+	}
+
+	nCPU = sysconf(_SC_NPROCESSORS_CONF);
+	Check_List = (CORE_CHECK *)calloc(nLoad, sizeof(CORE_CHECK));
+	for(i=0; i<nLoad; i++)	{
+		if(Load_List[i].core >= nCPU)	{
+			printf("Core %d does not exist. There are %d cores.\nQuit\n", Load_List[i].core, nCPU);
+			exit(1);
+		}
+		for(k=0; k<nCore_Checked; k++)	{
+			if(Check_List[k].core == Load_List[i].core)	break;
+		}
+		if(k == nCore_Checked)	{
+			Check_List[k].core = Load_List[i].core;
+			Sum_Duty[k] = 0.0;
+			nCore_Checked++;
+		}
+		Sum_Duty[k] += Load_List[i].duty;
+		if(Sum_Duty[k] > 1.0001)	printf("Warning: the load on core %d is over 100%%. The expected usage is capped at 100%%.\n", Load_List[i].core);
+	}
+
+	t_Start = Get_Time() + T_LEAD;
+	t_End = t_Start + tRun;
+
+	for(i=0; i<nLoad; i++)	{
+		CPU_ZERO(&mask);
+		CPU_SET(Load_List[i].core, &mask);
+		pthread_attr_init(&attr);
+		pthread_attr_setaffinity_np(&attr, sizeof(cpu_set_t), &mask);
+		if(pthread_create(&(Load_List[i].thread), &attr, Load_Main, &(Load_List[i])) != 0)	{
+			printf("Fail to create the thread on core %d. Is the core in your cpuset?\nQuit\n", Load_List[i].core);
+			exit(1);
+		}
+		pthread_attr_destroy(&attr);
+		sprintf(szName, "lg_c%d_%d", Load_List[i].core, (int)(100*Load_List[i].duty + 0.5));	// shows up in the app list of core_usage
+		pthread_setname_np(Load_List[i].thread, szName);
+	}
+	printf("%d threads start at %.3f and run for %.1f s.\n", nLoad, t_Start, tRun);
+
+	for(i=0; i<nLoad; i++)	{
+		pthread_join(Load_List[i].thread, NULL);
+	}
+	if(szLog == NULL)	return 0;
+
+	Sleep_Until(t_End + T_TAIL);
+	return (Check_Log(szLog, Tolerance) > 0) ? 1 : 0;
+}